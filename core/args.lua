@@ -117,6 +117,7 @@ if not mode then assert(io.open(user_init, 'w'), 'unable to create "%s"', user_i
 M.register('-u', '--userhome', 1, function() end, 'Sets alternate _USERHOME')
 M.register('-f', '--force', 0, function() end, 'Forces unique instance')
 M.register('-p', '--preserve', 0, function() end, 'Preserve ^Q (XON) and ^S (XOFF) flow control')
+M.register('-P', '--profile', 0, function() end, 'Profiles startup and event handlers')
 
 -- Run unit tests.
 -- Note: have them run after the last `events.INITIALIZED` handler so everything is completely
@@ -130,4 +131,35 @@ M.register('-t', '--test', 1, function(patterns)
 	end)
 end, 'Runs unit tests indicated by comma-separated list of patterns (or all)')
 
+-- Run a Lua script over files without a UI.
+-- Note: batch mode consumes all of the command line arguments that follow it, and it runs after
+-- the last `events.INITIALIZED` handler, like unit tests. Textadept quits afterwards.
+-- Benchmarks also run headless, so they count as batch mode too.
+local batch_narg = 0
+for i = 1, arg and #arg or 0 do
+	if arg[i] == '-b' or arg[i] == '--bench' then M._batch = true end
+	if arg[i] == '-B' or arg[i] == '--batch' then
+		batch_narg, M._batch = #arg - i, true
+		break
+	end
+end
+M.register('-j', '--jobs', 1, function(jobs) M.jobs = tonumber(jobs) end,
+	'Sets the number of batch mode worker processes (defaults to the number of processors)')
+M.register('-B', '--batch', batch_narg, function(script, ...)
+	local filenames = {...}
+	events.connect(events.INITIALIZED, function() require('batch')(script, filenames, M.jobs) end)
+	return true -- do not emit events.ARG_NONE
+end, 'Runs the given Lua script over the given files and directories without a UI, then quits')
+
+-- Run benchmarks and quit.
+-- Note: like unit tests, have them run after the last `events.INITIALIZED` handler.
+M.register('-b', '--bench', 1, function(patterns)
+	events.connect(events.INITIALIZED, function()
+		local arg = {}
+		for patt in (patterns or ''):gmatch('[^,]+') do arg[#arg + 1] = patt end
+		local env = setmetatable({arg = arg}, {__index = _G})
+		assert(loadfile(_HOME .. '/test/bench.lua', 't', env))()
+	end)
+end, 'Runs benchmarks indicated by comma-separated list of patterns (or all), then quits')
+
 return M
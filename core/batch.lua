@@ -0,0 +1,138 @@
+-- Copyright 2023 Mitchell. See LICENSE.
+
+-- Runs a Lua script over files without a UI, spreading those files across worker processes.
+-- This is invoked by the '-B' or '--batch' command line option:
+--
+--	textadept [-j jobs] -B script.lua [file or directory or @file_list ...]
+--
+-- The script is run once per file, with that file opened in the current buffer and its filename
+-- passed as the script's only argument. If the script modifies that buffer, it is saved. If no
+-- files are given, the script runs once in an empty buffer.
+-- Directories are searched for files using `lfs.default_filter`, and each line of a file prefixed
+-- by '@' is the name of a file or directory to process.
+-- Errors are printed to stdout in the form "filename: message", and Textadept exits with a
+-- non-zero status if any occurred.
+
+--- Returns the number of processors available, or 1 if that number cannot be determined.
+local function get_num_processors()
+	if WIN32 then return tonumber(os.getenv('NUMBER_OF_PROCESSORS')) or 1 end
+	local p = os.spawn('getconf _NPROCESSORS_ONLN')
+	return p and tonumber(p:read('a')) or 1
+end
+
+--- Returns a list of the files to process from the given list of command line arguments.
+local function get_filenames(args)
+	local filenames = {}
+	local function add(arg)
+		if arg:find('^@') then
+			for line in io.lines(lfs.abspath(arg:sub(2))) do if line ~= '' then add(line) end end
+		elseif lfs.attributes(lfs.abspath(arg), 'mode') == 'directory' then
+			for filename in lfs.walk(lfs.abspath(arg)) do filenames[#filenames + 1] = filename end
+		else
+			filenames[#filenames + 1] = lfs.abspath(arg)
+		end
+	end
+	for _, arg in ipairs(args) do add(arg) end
+	return filenames
+end
+
+--- Runs the given script over the given files in this process, and returns the number of
+-- errors that occurred.
+local function process(script, filenames)
+	local f, errmsg = loadfile(script)
+	if not f then
+		print(string.format('%s: %s', script, errmsg))
+		return 1
+	end
+	if #filenames == 0 then filenames = {false} end
+	local errors = 0
+	for _, filename in ipairs(filenames) do
+		local ok, errmsg = pcall(function()
+			if filename then io.open_file(filename) end
+			f(filename or nil)
+			if filename and buffer.modify then buffer:save() end
+		end)
+		if not ok then
+			print(string.format('%s: %s', filename or script, errmsg))
+			errors = errors + 1
+		end
+		while view:unsplit() do end
+		while #_BUFFERS > 1 or buffer.filename do buffer:close(true) end
+	end
+	return errors
+end
+
+--- Quotes the given command line argument for `os.spawn()`.
+-- Arguments containing double quotes are single-quoted instead, since not every platform
+-- unescapes "\"" within double quotes.
+local function quote(arg)
+	if not arg:find('"') then return '"' .. arg .. '"' end
+	assert(not arg:find("'"), 'cannot quote argument with both single and double quotes: ' .. arg)
+	return "'" .. arg .. "'"
+end
+
+--- Returns a function that writes output from a worker process to the given file, passing
+-- through only complete lines so that lines from concurrent workers are not interleaved.
+-- Calling that function without output writes any remaining partial line.
+local function line_writer(f)
+	local partial = ''
+	return function(output)
+		local text = partial .. (output or '')
+		local e = not output and #text + 1 or text:match('.*\n()') or 1
+		f:write(text:sub(1, e - 1))
+		partial = text:sub(e)
+	end
+end
+
+--- Runs the given script over the given files, split between *jobs* worker processes, and
+-- returns the number of workers that failed.
+-- The output of all workers is read as it arrives, since a worker whose output is not read
+-- would block once its pipe fills up.
+local function process_in_parallel(script, filenames, jobs)
+	local lists = {}
+	for i = 1, jobs do lists[i] = {} end
+	for i, filename in ipairs(filenames) do -- distribute round-robin in order to balance jobs
+		local list = lists[(i - 1) % jobs + 1]
+		list[#list + 1] = filename
+	end
+	local exe = arg[0]:find('[/\\]') and lfs.abspath(arg[0]) or arg[0]
+	local running, failures = 0, 0
+	for _, list in ipairs(lists) do
+		local list_file = os.tmpname()
+		local f = assert(io.open(list_file, 'wb'))
+		f:write(table.concat(list, '\n'), '\n')
+		f:close()
+		local cmd = string.format('%s -n -u %s -j 1 -B %s %s', quote(exe), quote(_USERHOME),
+			quote(script), quote('@' .. list_file))
+		local stdout, stderr = line_writer(io.stdout), line_writer(io.stderr)
+		local proc, errmsg = os.spawn(cmd, stdout, stderr, function(status)
+			stdout() -- write any partial lines
+			stderr()
+			if status ~= 0 then failures = failures + 1 end
+			os.remove(list_file)
+			running = running - 1
+		end)
+		if proc then
+			running = running + 1
+		else
+			print(string.format('%s: %s', script, errmsg))
+			os.remove(list_file)
+			failures = failures + 1
+		end
+	end
+	while running > 0 do ui._wait() end
+	return failures
+end
+
+return function(script, args, jobs)
+	local ok, errors = pcall(function()
+		script = lfs.abspath(script)
+		local filenames = get_filenames(args)
+		jobs = math.min(jobs or get_num_processors(), #filenames)
+		if jobs <= 1 then return process(script, filenames) end
+		return process_in_parallel(script, filenames, jobs)
+	end)
+	if not ok then print(errors) end
+	io.stdout:flush()
+	quit(ok and errors == 0 and 0 or 1)
+end
@@ -372,6 +372,25 @@ local handlers = setmetatable({}, {
 	end
 })
 
+-- Map of Scintilla notification event names to their notification codes.
+local notification_codes = {}
+for code, v in pairs(_SCINTILLA.events) do notification_codes[v[1]] = code end
+local SCN_STYLENEEDED = 2000 -- first notification code
+
+-- Bit-mask of Scintilla notifications that have connected handlers.
+-- Textadept only emits notifications whose bits are set, and bit n represents notification code
+-- `SCN_STYLENEEDED + n`.
+M._notification_mask = 0
+
+-- Updates `events._notification_mask` for event *event* if it is a Scintilla notification.
+local function update_notification_mask(event)
+	local code = notification_codes[event]
+	if not code then return end
+	local bit = 1 << (code - SCN_STYLENEEDED)
+	M._notification_mask = #handlers[event] > 0 and M._notification_mask | bit or
+		M._notification_mask & ~bit
+end
+
 --- Adds function *f* to the set of event handlers for event *event* at position *index*.
 -- If *index* not given, appends *f* to the set of handlers. *event* may be any arbitrary string
 -- and does not need to have been previously defined.
@@ -385,6 +404,7 @@ function M.connect(event, f, index)
 	assert_type(index, 'number/nil', 3)
 	M.disconnect(event, f) -- in case it already exists
 	table.insert(handlers[event], index or #handlers[event] + 1, f)
+	update_notification_mask(event)
 end
 
 --- Removes function *f* from the set of handlers for event *event*.
@@ -398,9 +418,19 @@ function M.disconnect(event, f)
 			break
 		end
 	end
+	update_notification_mask(event)
 end
 
 local error_emitted = false
+local profile = _PROFILE
+--- Map of event handlers to their names in profiling results.
+local handler_names = setmetatable({}, {
+	__mode = 'k', __index = function(t, f)
+		local info = debug.getinfo(f, 'S')
+		t[f] = string.format('%s:%d', info.short_src, info.linedefined)
+		return t[f]
+	end
+})
 --- Sequentially calls all handler functions for event *event* with the given arguments.
 -- *event* may be any arbitrary string and does not need to have been previously defined. If
 -- any handler explicitly returns a value that is not `nil`, `emit()` returns that value and
@@ -416,7 +446,11 @@ function M.emit(event, ...)
 	local i = 1
 	while i <= #event_handlers do
 		local handler = event_handlers[i]
+		local start = profile and profile.clock()
 		local ok, result = pcall(handler, ...)
+		if profile then
+			profile.record(string.format('handler: %s %s', event, handler_names[handler]), start)
+		end
 		if not ok then
 			if not error_emitted then
 				error_emitted = true
@@ -431,13 +465,16 @@ function M.emit(event, ...)
 	end
 end
 
--- Handles Scintilla notifications.
-M.connect('SCN', function(notification)
-	local iface = _SCINTILLA.events[notification.code]
-	local args = {}
-	for i = 2, #iface do args[i - 1] = notification[iface[i]] end
-	return M.emit(iface[1], table.unpack(args))
-end)
+-- When profiling, also record the total time spent emitting each event.
+if profile then
+	local emit = M.emit
+	function M.emit(event, ...)
+		local start = profile.clock()
+		local result = emit(event, ...)
+		profile.record('event: ' .. event, start)
+		return result
+	end
+end
 
 -- Set event constants.
 for _, v in pairs(_SCINTILLA.events) do M[v[1]:upper()] = v[1] end
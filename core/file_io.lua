@@ -29,12 +29,18 @@ for _, v in ipairs(file_io_events) do events[v:upper()] = v end
 -- - *saved_as*: Whether or not the file was saved under a different filename.
 -- @field _G.events.FILE_AFTER_SAVE
 
---- Emitted when Textadept detects that an open file was modified externally.
+--- Emitted when Textadept detects that open files were modified externally.
+-- Where supported, open files are watched for changes in the background, and a burst of changes
+-- (e.g. from switching version control branches) is emitted once, after it ends. Otherwise,
+-- files are checked when switching to their buffers and when Textadept regains focus. Files
+-- whose contents did not change (e.g. files that were only touched) are not emitted.
 -- When connecting to this event, connect with an index of 1 in order to override the default
--- prompt to reload the file.
+-- prompt to reload files.
 -- Arguments:
 --
--- - *filename*: The filename externally modified.
+-- - *filename*: The filename externally modified. If several files were modified at once,
+--	this is the first of them.
+-- - *filenames*: List of all filenames externally modified at once.
 -- @field _G.events.FILE_CHANGED
 
 --- Whether or not to ensure there is a final newline when saving text files.
@@ -46,6 +52,26 @@ io.ensure_final_newline = not WIN32
 -- The default value is `5000`.
 io.quick_open_max = 5000
 
+--- The size in bytes at or above which files are opened in large file mode.
+-- In this mode, undo collection is disabled and the file is not lexed. Re-enable them by
+-- setting `buffer.undo_collection` to `true` and calling `buffer:set_lexer()`, respectively.
+-- The default value is `100 * 1024 * 1024` (100 MB). A value of `nil` disables large file mode.
+io.large_file_size = 100 * 1024 * 1024
+
+--- The maximum number of lines the buffer reading from stdin (via the '-' command line option)
+-- may contain.
+-- When reading exceeds this limit, the oldest tenth of those lines is removed, which bounds the
+-- memory used by unending streams like `journalctl -f | textadept -`. `0` means there is
+-- no limit.
+-- The default value is `0`.
+io.stdin_max_lines = 0
+
+--- Whether or not to reload unmodified buffers whose files were modified externally without
+-- prompting.
+-- Buffers with unsaved changes are still prompted for.
+-- The default value is `false`.
+io.reload_unmodified_files = false
+
 --- List of recently opened files, the most recent being towards the top.
 io.recent_files = {}
 
@@ -70,6 +96,66 @@ io.recent_files = {}
 
 io.encodings = {'UTF-8', 'ASCII', 'CP1252', 'UTF-16'}
 
+-- Map of byte order marks to their encodings.
+local boms = {['\239\187\191'] = 'UTF-8', ['\255\254'] = 'UTF-16', ['\254\255'] = 'UTF-16'}
+
+--- Watches the given buffer's file for external changes, and stops watching the file it had
+-- before being saved under a different filename, if any.
+-- The filename watched has any symlinks resolved, and it is the one reported as changed.
+-- Watching the new file before unwatching the old one keeps an unchanged watch in place.
+local function watch(buffer)
+	local watched = buffer._watched
+	buffer._watched = io._watch_file(buffer.filename)
+	if watched then io._unwatch_file(watched) end
+end
+
+-- Loads file *filename*'s contents *text* into the current, empty buffer *buffer*, converting
+-- from encoding *encoding* or an auto-detected one, and emits `events.FILE_OPENED`.
+local function load_file(buffer, filename, text, encoding)
+	buffer._hash = io._hash(text)
+	if encoding then
+		buffer.encoding, text = encoding, text:iconv('UTF-8', encoding)
+	else
+		-- Try to detect character encoding and convert to UTF-8. Try any encoding identified by a
+		-- byte order mark first. UTF-8 and ASCII text can be validated without converting it.
+		local has_zeroes = text:sub(1, 65535):find('\0')
+		local bom = boms[text:sub(1, 3)] or boms[text:sub(1, 2)]
+		for _, encoding in ipairs(bom and {bom, table.unpack(io.encodings)} or io.encodings) do
+			local native = encoding == 'UTF-8' or encoding == 'ASCII'
+			if encoding == 'UTF-8' and text:is_utf8() or
+				(encoding == 'ASCII' and not has_zeroes and not text:find('[\128-\255]')) then
+				buffer.encoding = encoding
+				goto encoding_detected
+			elseif not native and (not has_zeroes or encoding:find('^UTF')) then
+				local ok, conv = pcall(string.iconv, text, 'UTF-8', encoding)
+				if ok then
+					buffer.encoding, text = encoding, conv
+					goto encoding_detected
+				end
+			end
+		end
+		assert(has_zeroes, _L['Encoding conversion failed.'])
+		buffer.encoding = nil -- binary (default was 'UTF-8')
+	end
+	::encoding_detected::
+	buffer.code_page = buffer.encoding and buffer.CP_UTF8 or 0
+	-- Detect EOL mode.
+	local s, e = text:find('\r?\n')
+	if s then buffer.eol_mode = buffer[s ~= e and 'EOL_CRLF' or 'EOL_LF'] end
+	-- Insert buffer text and set properties.
+	local large = io.large_file_size and #text >= io.large_file_size
+	buffer.undo_collection = not large
+	buffer:append_text(text)
+	view.first_visible_line, view.x_offset = 1, 0 -- reset view scroll
+	buffer:empty_undo_buffer()
+	buffer.mod_time = lfs.attributes(filename, 'modification') or os.time()
+	buffer.filename = filename
+	watch(buffer)
+	buffer:set_save_point()
+	buffer:set_lexer(large and 'text' or nil) -- auto-detect unless large
+	events.emit(events.FILE_OPENED, filename)
+end
+
 --- Opens *filenames*, a string filename or list of filenames, or the user-selected filename(s).
 -- Emits `events.FILE_OPENED`.
 -- @param[opt] filenames Optional string filename or table of filenames to open. If `nil`,
@@ -104,38 +190,7 @@ function io.open_file(filenames, encodings)
 			f:close()
 			if not text then goto continue end -- filename exists, but cannot read it
 		end
-		local buffer = buffer.new()
-		if encodings[i] then
-			buffer.encoding, text = encodings[i], text:iconv('UTF-8', encodings[i])
-		else
-			-- Try to detect character encoding and convert to UTF-8.
-			local has_zeroes = text:sub(1, 65535):find('\0')
-			for _, encoding in ipairs(io.encodings) do
-				if not has_zeroes or encoding:find('^UTF') then
-					local ok, conv = pcall(string.iconv, text, 'UTF-8', encoding)
-					if ok then
-						buffer.encoding, text = encoding, conv
-						goto encoding_detected
-					end
-				end
-			end
-			assert(has_zeroes, _L['Encoding conversion failed.'])
-			buffer.encoding = nil -- binary (default was 'UTF-8')
-		end
-		::encoding_detected::
-		buffer.code_page = buffer.encoding and buffer.CP_UTF8 or 0
-		-- Detect EOL mode.
-		local s, e = text:find('\r?\n')
-		if s then buffer.eol_mode = buffer[s ~= e and 'EOL_CRLF' or 'EOL_LF'] end
-		-- Insert buffer text and set properties.
-		buffer:append_text(text)
-		view.first_visible_line, view.x_offset = 1, 0 -- reset view scroll
-		buffer:empty_undo_buffer()
-		buffer.mod_time = lfs.attributes(filename, 'modification') or os.time()
-		buffer.filename = filename
-		buffer:set_save_point()
-		buffer:set_lexer() -- auto-detect
-		events.emit(events.FILE_OPENED, filename)
+		load_file(buffer.new(), filename, text, encodings[i])
 
 		-- Add file to recent files list, eliminating duplicates.
 		table.insert(io.recent_files, 1, filename)
@@ -149,13 +204,47 @@ function io.open_file(filenames, encodings)
 	end
 end
 
+--- Loads the current buffer's file if that buffer was created without reading its contents.
+-- This allows opening files on demand (e.g. when restoring a session). A buffer is created this
+-- way by assigning its `filename` and setting its `_deferred` field to `true`.
+-- As with `io.open_file()`, a file that no longer exists is opened as a new file. If the file
+-- cannot be loaded, the buffer becomes untitled so that saving it cannot overwrite that file,
+-- and an error is raised.
+local function load_deferred_file()
+	if not buffer._deferred then return end
+	buffer._deferred = nil
+	local filename, text, errmsg, ok = buffer.filename, ''
+	if lfs.attributes(filename) then
+		local f
+		f, errmsg = io.open(filename, 'rb')
+		text = f and f:read('a')
+		if f then f:close() end
+	end
+	if text then ok, errmsg = pcall(load_file, buffer, filename, text) end
+	if ok then return end
+	buffer.filename, buffer._session = nil, nil
+	events.emit(events.SAVE_POINT_REACHED, buffer) -- update tab label
+	error(string.format('cannot open %s', errmsg or filename), 2)
+end
+events.connect(events.BUFFER_AFTER_SWITCH, load_deferred_file, 1)
+events.connect(events.VIEW_AFTER_SWITCH, load_deferred_file, 1)
+
+--- Loads the given buffer's file if that buffer was created without reading its contents,
+-- switching to that buffer if necessary, since files are loaded into the current buffer.
+local function load_deferred(buffer)
+	if not buffer._deferred then return end
+	if buffer ~= _G.buffer then view:goto_buffer(buffer) else load_deferred_file() end
+end
+
 -- LuaDoc is in core/.buffer.luadoc.
 local function reload(buffer)
 	if not buffer then buffer = _G.buffer end
 	if not buffer.filename then return end
+	if buffer._deferred then return load_deferred(buffer) end -- loading it is reloading it
 	local f = assert(io.open(buffer.filename, 'rb'))
 	local text = f:read('a')
 	f:close()
+	buffer._hash = io._hash(text)
 	if buffer.encoding then text = text:iconv('UTF-8', buffer.encoding) end
 	buffer:target_whole_document()
 	buffer:replace_target(text)
@@ -181,22 +270,35 @@ local function set_encoding(buffer, encoding)
 	buffer.code_page = buffer.encoding and buffer.CP_UTF8 or 0
 end
 
--- LuaDoc is in core/.buffer.luadoc.
-local function save(buffer)
-	if not buffer then buffer = _G.buffer end
-	if not buffer.filename then return buffer:save_as() end
+--- Prepares the given buffer for saving and returns its file table for `io._write_files()`.
+-- The buffer's text is written straight from the buffer and converted to its encoding while
+-- being written, so saving does not hold a copy of the text in memory.
+local function get_save_file(buffer)
 	events.emit(events.FILE_BEFORE_SAVE, buffer.filename)
 	if io.ensure_final_newline and buffer.encoding and buffer.char_at[buffer.length] ~= 10 then
 		buffer:append_text(buffer.eol_mode == buffer.EOL_LF and '\n' or '\r\n')
 	end
-	local text = buffer:get_text()
-	if buffer.encoding then text = text:iconv(buffer.encoding, 'UTF-8') end
-	assert(io.open(buffer.filename, 'wb')):write(text):close()
+	return {buffer.filename, buffer = buffer, encoding = buffer.encoding}
+end
+
+--- Marks the given buffer as saved after its text, whose hash is *hash*, has been written.
+local function saved(buffer, hash)
 	buffer:set_save_point()
 	if buffer ~= _G.buffer then events.emit(events.SAVE_POINT_REACHED, buffer) end -- update tab label
-	buffer.mod_time = lfs.attributes(buffer.filename, 'modification')
+	buffer.mod_time, buffer._hash = lfs.attributes(buffer.filename, 'modification'), hash
+	watch(buffer)
 	if buffer._type then buffer._type = nil end
 	events.emit(events.FILE_AFTER_SAVE, buffer.filename)
+end
+
+-- LuaDoc is in core/.buffer.luadoc.
+local function save(buffer)
+	if not buffer then buffer = _G.buffer end
+	if not buffer.filename then return buffer:save_as() end
+	if buffer._deferred then return true end -- not loaded yet, so do not clobber the file
+	local results, hashes = io._write_files{get_save_file(buffer)}
+	assert(results[1] == true, results[1])
+	saved(buffer, hashes[1])
 	return true
 end
 
@@ -208,6 +310,7 @@ local function save_as(buffer, filename)
 		filename = ui.dialogs.save{title = _L['Save File'], dir = dir, file = name}
 		if not filename then return end
 	end
+	load_deferred(buffer) -- otherwise there would be nothing to save
 	buffer.filename = filename
 	buffer:save()
 	buffer:set_lexer() -- auto-detect
@@ -217,17 +320,29 @@ end
 
 --- Saves all unsaved buffers to their respective files, prompting the user for filenames for
 -- untitled buffers if *untitled* is `true`, and returns `true` on success.
--- Print and output buffers are ignored.
+-- Print and output buffers are ignored. Files are written concurrently.
 -- @param untitled Whether or not to prompt for filenames for untitled buffers. The default
 --	value is `false`.
 -- @return `true` if all savable files were saved; `nil` otherwise.
 function io.save_all_files(untitled)
+	-- Prepare all files first, then write them concurrently.
+	local files, buffers = {}, {}
 	for _, buffer in ipairs(_BUFFERS) do
 		if buffer.modify and (buffer.filename or untitled and not buffer._type) then
-			if not buffer.filename then view:goto_buffer(buffer) end
-			if not buffer:save() then return end
+			if not buffer.filename then
+				view:goto_buffer(buffer)
+				if not buffer:save() then return end
+			elseif not buffer._deferred then
+				files[#files + 1], buffers[#buffers + 1] = get_save_file(buffer), buffer
+			end
 		end
 	end
+	local errmsg
+	local results, hashes = io._write_files(files)
+	for i, result in ipairs(results) do
+		if result == true then saved(buffers[i], hashes[i]) else errmsg = errmsg or result end
+	end
+	assert(not errmsg, errmsg)
 	return true
 end
 
@@ -250,29 +365,70 @@ local function close(buffer, force)
 	return true
 end
 
+--- Returns whether or not the given buffer's file has been externally modified since it was
+-- last read or written, and notes its current modification time and hash.
+-- Files with a newer modification time but the same contents are not considered modified.
+-- @param buffer The buffer to check.
+-- @param notified Whether or not the file watcher reported a change to the file. If so, the
+--	file's contents are checked even if its modification time is the same, since that time may
+--	only have a 1-second granularity.
+local function file_changed(buffer, notified)
+	local mod_time = lfs.attributes(buffer.filename, 'modification')
+	if not mod_time or not buffer.mod_time then return false end
+	if buffer.mod_time >= mod_time and not (notified and buffer._hash) then return false end
+	buffer.mod_time = mod_time
+	local hash = buffer._hash and io._hash_file(buffer.filename)
+	if hash and hash == buffer._hash then return false end
+	buffer._hash = hash
+	return true
+end
+
 --- Detects if the current file has been externally modified and, if so, emits
 -- `events.FILE_CHANGED`.
 local function update_modified_file()
-	if not buffer.filename then return end
-	local mod_time = lfs.attributes(buffer.filename, 'modification')
-	if mod_time and buffer.mod_time and buffer.mod_time < mod_time then
-		buffer.mod_time = mod_time
-		events.emit(events.FILE_CHANGED, buffer.filename)
-	end
+	if not buffer.filename or buffer._deferred or not file_changed(buffer) then return end
+	events.emit(events.FILE_CHANGED, buffer.filename, {buffer.filename})
 end
 events.connect(events.BUFFER_AFTER_SWITCH, update_modified_file)
 events.connect(events.VIEW_AFTER_SWITCH, update_modified_file)
 events.connect(events.FOCUS, update_modified_file)
 events.connect(events.RESUME, update_modified_file)
 
+--- Returns the given filename in a form suitable for comparing with other filenames.
+local function normalize(filename)
+	return not WIN32 and filename or filename:gsub('/', '\\'):lower()
+end
+
+-- Emits `events.FILE_CHANGED` once for all buffers whose files the file watcher reported as
+-- changed, or for all buffers if some changes may have been missed.
+io._watch_files(function(filenames, lost)
+	local reported, changed = {}, {}
+	for _, filename in ipairs(filenames) do reported[normalize(filename)] = true end
+	for _, buffer in ipairs(_BUFFERS) do
+		local notified = buffer._watched and reported[normalize(buffer._watched)]
+		if buffer._watched and (notified or lost) and file_changed(buffer, notified) then
+			changed[#changed + 1] = buffer.filename
+		end
+	end
+	if #changed > 0 then events.emit(events.FILE_CHANGED, changed[1], changed) end
+end)
+
+-- Stops watching the files of closed buffers.
+events.connect(events.BUFFER_DELETED, function(buffer)
+	if buffer._watched then io._unwatch_file(buffer._watched) end
+end)
+
 --- Closes all open buffers, prompting the user to continue if there are unsaved buffers, and
 -- returns `true` if the user did not cancel.
 -- No buffers are saved automatically. They must be saved manually.
 -- @return `true` if user did not cancel; `nil` otherwise.
 function io.close_all_buffers()
 	events.disconnect(events.BUFFER_AFTER_SWITCH, update_modified_file)
-	while #_BUFFERS > 1 do if not buffer:close() then return nil end end
+	events.disconnect(events.BUFFER_AFTER_SWITCH, load_deferred_file) -- do not load doomed files
+	while #_BUFFERS > 1 and buffer:close() do end
+	events.connect(events.BUFFER_AFTER_SWITCH, load_deferred_file, 1)
 	events.connect(events.BUFFER_AFTER_SWITCH, update_modified_file)
+	if #_BUFFERS > 1 then return (load_deferred_file()) end -- canceled
 	return buffer:close() -- the last one
 end
 
@@ -287,23 +443,43 @@ end)
 -- access buffer functions before the first `events.BUFFER_NEW` is emitted.
 io._reload, io._save, io._save_as, io._close = reload, save, save_as, close
 
--- Prompts the user to reload the current file if it has been externally modified.
-events.connect(events.FILE_CHANGED, function(filename)
+-- Reloads unmodified buffers whose files were externally modified if
+-- `io.reload_unmodified_files` is `true`, and prompts the user to reload the rest.
+events.connect(events.FILE_CHANGED, function(filename, filenames)
+	local buffers, names = {}, {}
+	for _, filename in ipairs(filenames or {filename}) do
+		for _, buffer in ipairs(_BUFFERS) do
+			if buffer.filename == filename and not buffer._deferred then
+				if io.reload_unmodified_files and not buffer.modify then
+					buffer:reload()
+				else
+					buffers[#buffers + 1] = buffer
+					names[#names + 1] = string.format('"%s"', filename:iconv('UTF-8', _CHARSET))
+				end
+				break
+			end
+		end
+	end
+	if #buffers == 0 then return end
+	local one = #buffers == 1
 	local button = ui.dialogs.message{
-		title = _L['Reload modified file?'],
-		text = string.format('"%s"\n%s', filename:iconv('UTF-8', _CHARSET),
-			_L['has been modified. Reload it?']), icon = 'dialog-question', button1 = _L['Yes'],
-		button2 = _L['No']
+		title = one and _L['Reload modified file?'] or _L['Reload modified files?'],
+		text = string.format('%s\n%s', table.concat(names, '\n'),
+			one and _L['has been modified. Reload it?'] or _L['have been modified. Reload them?']),
+		icon = 'dialog-question', button1 = _L['Yes'], button2 = _L['No']
 	}
-	if button == 1 then buffer:reload() end
+	if button == 1 then for _, buffer in ipairs(buffers) do buffer:reload() end end
 end)
 
--- Closes the initial "Untitled" buffer when another buffer is opened.
-events.connect(events.FILE_OPENED, function()
+--- Closes the initial "Untitled" buffer if it is unused and only one other buffer has been
+-- opened.
+-- This is also called by modules that open buffers without emitting `events.FILE_OPENED`.
+function io._close_initial_buffer()
 	if #_BUFFERS > 2 then return end
 	local buf = _BUFFERS[1]
 	if not (buf.filename or buf._type or buf.modify) then buf:close() end
-end)
+end
+events.connect(events.FILE_OPENED, io._close_initial_buffer)
 
 --- Prompts the user to select a recently opened file to be reopened.
 -- @see recent_files
@@ -359,6 +535,88 @@ end
 --- Map of directory paths to filters used by `io.quick_open()`.
 io.quick_open_filters = {}
 
+-- Map of quick open directory paths and filters to maps of the directories walked to their
+-- cached listings.
+local quick_open_cache = {}
+
+-- Adds to map *listings* the listing of directory *dir* and each of its sub-directories, walked
+-- using filter *filter*.
+-- If *depth* is 0, only *dir* itself is listed. A listing contains the files and sub-directories
+-- directly in its directory, the symlink targets of those sub-directories, and the directory's
+-- modification time before it was listed.
+local function list_dirs(listings, dir, filter, depth)
+	local time, sep = os.time(), not WIN32 and '/' or '\\'
+	local function listing_of(dir)
+		if not listings[dir] then
+			listings[dir] = {
+				mtime = lfs.attributes(dir, 'modification'), time = time, files = {}, dirs = {},
+				links = {}
+			}
+		end
+		return listings[dir]
+	end
+	listings[dir] = nil -- replace any existing listing
+	listing_of(dir)
+	for filename in lfs.walk(dir, filter, depth, true) do
+		local parent, name = filename:match('^(.*)[/\\]([^/\\]+[/\\]?)$')
+		if parent == '' then parent = dir end -- in the root directory
+		local listing = listing_of(parent)
+		if name:find('[/\\]$') then
+			local subdir = filename:sub(1, -2)
+			listing.dirs[#listing.dirs + 1] = subdir
+			local link = lfs.symlinkattributes(subdir, 'target')
+			if link then
+				listing.links[subdir] = lfs.abspath(link .. sep, parent):gsub('[/\\]+$', '')
+			end
+			if depth ~= 0 then
+				listings[subdir] = nil -- replace any existing listing
+				listing_of(subdir)
+			end
+		else
+			listing.files[#listing.files + 1] = filename
+		end
+	end
+end
+
+-- Returns a list of files in directory *path* that match filter *filter*, up to
+-- `io.quick_open_max` files.
+-- The listing of each directory walked is cached along with its modification time. Later,
+-- only directories that changed since (i.e. had files added, removed, or renamed) are listed
+-- again, and only new sub-directories are walked. This avoids walking and filtering every file
+-- in a large project each time, although the first list for a directory needs a full walk.
+-- Like `lfs.walk()`, symlinked directories whose targets were already walked are skipped.
+local function get_quick_open_list(path, filter)
+	local key = path .. '\0' .. (type(filter) == 'table' and table.concat(filter, '\0') or filter)
+	local cached, listings, files, seen = quick_open_cache[key] or {}, {}, {}, {}
+	local function add(dir)
+		seen[dir] = true
+		local mtime = lfs.attributes(dir, 'modification')
+		if not mtime then return end -- removed
+		local listing = cached[dir]
+		if not listing then
+			list_dirs(cached, dir, filter)
+		elseif listing.mtime ~= mtime or mtime >= listing.time - 1 then
+			-- Changes made within a modification time's granularity of listing could go unnoticed.
+			list_dirs(cached, dir, filter, 0)
+		end
+		listing = cached[dir]
+		listings[dir] = listing
+		for _, filename in ipairs(listing.files) do
+			if #files >= io.quick_open_max then return end
+			files[#files + 1] = filename
+		end
+		for _, subdir in ipairs(listing.dirs) do
+			if #files >= io.quick_open_max then return end
+			local target = listing.links[subdir]
+			if not (target and seen[target]) then add(subdir) end
+		end
+	end
+	local dir = path:match('^(..-)[/\\]?$')
+	add(not WIN32 and dir or (dir:gsub('/', '\\')))
+	quick_open_cache[key] = listings
+	return files
+end
+
 --- Prompts the user to select files to be opened from *paths*, a string directory path or list
 -- of directory paths, using a list dialog.
 -- If *paths* is `nil`, uses the current project's root directory, which is obtained from
@@ -396,7 +654,7 @@ function io.quick_open(paths, filter)
 	paths = type(paths) == 'table' and paths or {paths}
 	local prefix = #paths == 1 and paths[1] .. (not WIN32 and '/' or '\\')
 	for _, path in ipairs(paths) do
-		for filename in lfs.walk(path, filter) do
+		for _, filename in ipairs(get_quick_open_list(path, filter)) do
 			if #utf8_list >= io.quick_open_max then break end
 			if prefix then filename = filename:sub(#prefix + 1) end
 			utf8_list[#utf8_list + 1] = filename:iconv('UTF-8', _CHARSET)
@@ -423,8 +681,38 @@ function io.quick_open(paths, filter)
 	io.open_file(filenames)
 end
 
+--- Appends the given input read from stdin to the given buffer.
+-- Views whose carets are at the end of that buffer stay there, following the input. Appending
+-- does not record undo history or mark the buffer as modified, and input to a closed buffer
+-- is discarded.
+local function append_stdin(buffer, input)
+	if not input or not _BUFFERS[buffer] then return end
+	local following = {}
+	for _, view in ipairs(_VIEWS) do
+		if view.buffer == buffer and view.current_pos == buffer.length + 1 then
+			following[#following + 1] = view
+		end
+	end
+	local modified = buffer.modify
+	buffer.undo_collection = false
+	buffer:append_text(input)
+	local max = io.stdin_max_lines
+	if max > 0 and buffer.line_count > max then
+		local excess = buffer.line_count - (max - max // 10)
+		buffer:delete_range(1, buffer:position_from_line(excess + 1) - 1)
+		buffer:empty_undo_buffer() -- positions in undo history are no longer valid
+	end
+	buffer.undo_collection = true
+	if not modified then buffer:set_save_point() end
+	for _, view in ipairs(following) do view:goto_pos(buffer.length + 1) end
+end
+
+-- Reads stdin into a new buffer as input arrives, if the platform can watch stdin. Otherwise,
+-- reads all of stdin at once.
 args.register('-', '-', 0, function()
 	if buffer.filename or buffer._type then buffer.new() end
+	local buffer = buffer
+	if io._read_stdin(function(input) append_stdin(buffer, input) end) then return true end
 	buffer:append_text(io.read('a'))
 	buffer:set_save_point()
 	return true -- this counts as a "file"
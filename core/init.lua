@@ -23,6 +23,7 @@ lexer = require('lexer')
 require('lfs_ext')
 require('ui')
 keys = require('keys')
+if _PROFILE then require('profile') end
 
 -- pdcurses compatibility.
 if CURSES and WIN32 then
@@ -48,6 +49,117 @@ if CURSES and WIN32 then
 	end
 end
 
+--- Methods for processes spawned by `os.spawn_async()`.
+-- Each process has the underlying `os.spawn()` process (*proc*), its exit status once it has
+-- exited (*code*), and the coroutines waiting on it (*waiters*). Pending stdout is the unread
+-- part of *buf* starting at *pos*, followed by any *chunks* received since, which are only
+-- concatenated when read. *len* is the number of pending bytes, and *lines* is whether or not
+-- there is a pending newline.
+local async_proc = {}
+async_proc.__index = async_proc
+
+--- Suspends the calling coroutine until the given process produces output or exits.
+local function suspend(proc)
+	local co, main = coroutine.running()
+	assert(not main and coroutine.isyieldable(), 'must be called from a coroutine')
+	proc.waiters[#proc.waiters + 1] = co
+	coroutine.yield()
+end
+
+--- Resumes the coroutines waiting on the given process, if any.
+-- Every waiting coroutine is resumed before any error raised by one of them is propagated.
+local function resume(proc)
+	local waiters, errors = proc.waiters, {}
+	proc.waiters = {}
+	for _, co in ipairs(waiters) do
+		local ok, errmsg = coroutine.resume(co)
+		if not ok then errors[#errors + 1] = debug.traceback(co, errmsg) end
+	end
+	if #errors > 0 then error(table.concat(errors, '\n'), 0) end
+end
+
+-- LuaDoc is in core/.os.luadoc.
+function os.spawn_async(cmd, ...)
+	assert_type(cmd, 'string', 1)
+	local args, n, stderr_cb = {}, 0, nil
+	for i = 1, select('#', ...) do
+		local arg = select(i, ...)
+		if type(arg) == 'function' then
+			stderr_cb = arg
+		elseif arg ~= nil then
+			n = n + 1
+			args[n] = arg -- cwd or env
+		end
+	end
+	local proc = setmetatable({buf = '', pos = 1, chunks = {}, len = 0, waiters = {}}, async_proc)
+	args[n + 1] = function(output)
+		proc.chunks[#proc.chunks + 1], proc.len = output, proc.len + #output
+		if not proc.lines and output:find('\n', 1, true) then proc.lines = true end
+		resume(proc)
+	end
+	args[n + 2] = stderr_cb
+	args[n + 3] = function(code)
+		proc.code = code
+		resume(proc)
+	end
+	local p, errmsg = os.spawn(cmd, table.unpack(args, 1, n + 3))
+	if not p then return nil, errmsg end
+	proc.proc = p
+	return proc
+end
+
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:read(arg)
+	arg = arg or 'l'
+	if type(arg) == 'string' then arg = arg:gsub('^%*', '') end
+	assert(math.type(arg) == 'integer' or arg == 'l' or arg == 'L' or arg == 'a', 'invalid option')
+	-- Wait until enough output is available or the process exits.
+	local ready
+	repeat
+		if arg == 'a' then
+			ready = self.code
+		elseif type(arg) == 'number' then
+			ready = self.len >= arg or self.code
+		else
+			ready = self.lines or self.code
+		end
+		if not ready then suspend(self) end
+	until ready
+	if #self.chunks > 0 then
+		self.buf = self.buf:sub(self.pos) .. table.concat(self.chunks)
+		self.pos, self.chunks = 1, {}
+	end
+	local buf, pos = self.buf, self.pos
+	if self.len == 0 and arg ~= 'a' and (arg ~= 0 or self.code) then return nil end -- EOF
+	local len = self.len
+	if type(arg) == 'number' then
+		len = math.min(arg, len)
+	elseif arg ~= 'a' then
+		local e = buf:find('\n', pos, true)
+		if e then len = e - pos + 1 end
+	end
+	local text = buf:sub(pos, pos + len - 1)
+	self.pos, self.len = pos + len, self.len - len
+	if self.lines then self.lines = buf:find('\n', self.pos, true) ~= nil end
+	if self.len == 0 then self.buf, self.pos = '', 1 end
+	return arg ~= 'l' and text or (text:gsub('\n$', ''))
+end
+
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:wait()
+	while not self.code do suspend(self) end
+	return self.code
+end
+
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:status() return not self.code and 'running' or 'terminated' end
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:write(...) return self.proc:write(...) or self end
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:close() return self.proc:close() or self end
+-- LuaDoc is in core/.os.luadoc.
+function async_proc:kill(signal) self.proc:kill(signal) end
+
 --- Replacement for original `buffer:text_range()`, which has a C struct for an argument.
 -- Documentation is in core/.buffer.luadoc.
 local function text_range(buffer, start_pos, end_pos)
@@ -200,6 +312,7 @@ end, 1)
 -- @function move_buffer
 
 --- Emits `events.QUIT`, and unless any handler returns `false`, quits Textadept.
+-- @param[opt=0] status Optional status code for Textadept to exit with.
 -- @function quit
 
 --- Resets the Lua State by reloading all initialization scripts.
@@ -13,6 +13,9 @@ M.names = function(path) return names(path or _LEXERPATH) end
 --- Emitted after loading a language lexer.
 -- This is useful for automatically loading language modules as source files are opened, or
 -- setting up language-specific editing features for source files.
+-- Lexers are loaded once and shared by all buffers that use them, so a handler that modifies
+-- `buffer.lexer` (e.g. by calling `lexer.add_rule()` or `lexer.modify_rule()`) modifies it for
+-- all of those buffers, and should only do so once per lexer.
 -- Arguments:
 --
 -- - *name*: The language lexer's name.
@@ -32,6 +35,39 @@ local function get_lexer(buffer, current)
 	return buffer.lexer_language
 end
 
+--- Map of lexer cache keys to loaded lexers.
+-- Loading a lexer compiles its grammar, so lexers are loaded once per name and lexer path and
+-- then shared by all buffers that use them. Each cached lexer also has the properties it set
+-- while loading (*properties*) and, for multi-language lexers, a map of style numbers considered
+-- to be whitespace styles (*ws*). Buffers must not modify any of these.
+-- This is a field rather than an upvalue because buffers keep their original `set_lexer()`
+-- closures through a reset, and those must see a new, empty cache afterwards so that edited
+-- lexers are reloaded.
+M._loaded = {}
+
+--- Returns the lexer with the given name, loading and caching it if necessary.
+-- @param name String lexer name.
+local function load_lexer(name)
+	local key = name .. '\0' .. _LEXERPATH
+	local cached = lexer._loaded[key]
+	if cached then
+		for k, v in pairs(cached.properties) do lexer.property[k] = v end
+		return cached
+	end
+	lexer.property['scintillua.lexers'] = _LEXERPATH
+	local lex = lexer.load(name)
+	if not lex then return nil end
+	cached = {lexer = lex, properties = {}}
+	for k, v in pairs(lexer.property) do cached.properties[k] = v end
+	if lex._CHILDREN then
+		local ws = {}
+		for i = 1, view.STYLE_MAX do ws[i] = (lex._TAGS[i] or ''):find('whitespace') ~= nil end
+		cached.ws = ws
+	end
+	lexer._loaded[key] = cached
+	return cached
+end
+
 -- LuaDoc is in core/.buffer.luadoc.
 -- Note: cannot use `M.` references here since these buffer functions persist through reset
 -- (thus referencing the original, unreset `M` upvalue).
@@ -42,17 +78,11 @@ local function set_lexer(buffer, name)
 
 	-- Setup the lexer.
 	for k in pairs(lexer.property) do lexer.property[k] = nil end -- clear existing properties
-	lexer.property['scintillua.lexers'] = _LEXERPATH
-	rawset(buffer, 'lexer', lexer.load(name))
+	local cached = load_lexer(name)
+	rawset(buffer, 'lexer', cached and cached.lexer)
 	rawset(buffer, 'lexer_language', name)
-	if rawget(buffer, 'lexer') then
-		rawset(buffer, 'named_styles', #buffer.lexer._TAGS)
-		if buffer.lexer._CHILDREN then
-			local ws = {} -- style numbers considered to be whitespace styles in multi-language lexers
-			for i = 1, view.STYLE_MAX do ws[i] = buffer:name_of_style(i):find('whitespace') ~= nil end
-			if #ws > 0 then buffer._ws = ws end
-		end
-	end
+	if cached then rawset(buffer, 'named_styles', #cached.lexer._TAGS) end
+	buffer._ws = cached and cached.ws -- shared style numbers considered to be whitespace styles
 
 	-- Update styles, forward folding properties to the lexer, copy lexer-specific properties to
 	-- the buffer, and refresh syntax highlighting.
@@ -84,8 +114,26 @@ local function style_of_name(buffer, name)
 	return lexer and lexer._TAGS[assert_type(name, 'string', 2):gsub('_', '.')] or view.STYLE_DEFAULT
 end
 
+-- Map of style numbers to their single-byte strings for use with `buffer:set_styling_ex()`.
+local style_bytes, rep = {}, string.rep
+for i = 0, 255 do style_bytes[i] = string.char(i) end
+
+-- Returns a position at or before position *pos* in a buffer with style table *style_at*
+-- where a new style starts.
+-- Rather than stepping back one position at a time, which is slow for long tokens like block
+-- comments or strings, look exponentially further back for a different style and then find the
+-- first style change after it. The result may precede the start of *pos*'s own style, which is
+-- still a safe place to start lexing from.
+local function find_style_start(style_at, pos)
+	local style, step, prev = style_at[pos], 1, pos
+	repeat prev, step = math.max(pos - step, 1), step * 2 until prev == 1 or style_at[prev] ~= style
+	if style_at[prev] == style then return 1 end
+	repeat prev = prev + 1 until style_at[prev] ~= style_at[prev - 1]
+	return prev
+end
+
 --- Performs syntax highlighting in buffer *buffer* from *start_pos* to *end_pos*.
--- Start from the beginning of the current style so the lexer can match the tag.
+-- Start from the beginning of a style so the lexer can match the tag.
 -- For multilang lexers, start at whitespace since embedded languages have whitespace.[lang]
 -- styles. This is so the lexer can start matching child languages instead of parent ones
 -- if necessary.
@@ -94,8 +142,11 @@ end
 -- @param end_pos Position to stop syntax highlighting at.
 local function highlight(buffer, start_pos, end_pos)
 	local style_at, ws = buffer.style_at, buffer._ws
-	local init_style = start_pos > 1 and style_at[start_pos - 1] or view.STYLE_DEFAULT
-	while start_pos > 1 and style_at[start_pos - 1] == init_style do start_pos = start_pos - 1 end
+	local init_style = view.STYLE_DEFAULT
+	if start_pos > 1 then
+		start_pos = find_style_start(style_at, start_pos - 1)
+		init_style = style_at[start_pos]
+	end
 	if ws then while start_pos > 1 and not ws[style_at[start_pos]] do start_pos = start_pos - 1 end end
 
 	-- Setup buffer-specific lexer fields.
@@ -109,15 +160,18 @@ local function highlight(buffer, start_pos, end_pos)
 	lexer.line_state, lexer.indent_amount = buffer.line_state, buffer.line_indentation
 
 	-- Invoke the lexer and style text from the returned table of tags.
+	-- Build the style bytes for the entire range first so Scintilla only needs to be called once.
 	buffer:start_styling(start_pos, 0)
 	local styles = buffer.lexer:lex(buffer:text_range(start_pos, end_pos), init_style)
-	local set_styling, tags, pos = buffer.set_styling, buffer.lexer._TAGS, 1
+	local tags, default, bytes, pos = buffer.lexer._TAGS, style_bytes[view.STYLE_DEFAULT], {}, 1
 	for i = 1, #styles, 2 do
 		local e = styles[i + 1]
-		set_styling(buffer, e - pos, tags[styles[i]] or view.STYLE_DEFAULT) -- support legacy lexers
+		local style = style_bytes[tags[styles[i]]] or default -- support legacy lexers
+		bytes[#bytes + 1] = rep(style, e - pos)
 		pos = e
 	end
-	buffer:set_styling(end_pos - (start_pos + pos - 1), view.STYLE_DEFAULT)
+	bytes[#bytes + 1] = rep(default, end_pos - (start_pos + pos - 1))
+	buffer:set_styling_ex(table.concat(bytes))
 
 	-- Invoke the folder and fold the text from the returned table of fold levels.
 	local line = buffer:line_from_position(start_pos)
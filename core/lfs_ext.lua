@@ -39,11 +39,16 @@ local function walk(dir, filter, n, include_dirs, seen, level)
 		elseif mode == 'directory' then
 			include = filter.consider_any
 		end
-		for _, patt in ipairs(filter) do
-			-- Treat exclusive patterns as logical AND.
-			if patt:find('^!') and filename:find(patt:sub(2)) then goto continue end
-			-- Treat inclusive patterns as logical OR.
-			include = include or (not patt:find('^!') and filename:find(patt))
+		-- Treat exclusive patterns as logical AND.
+		for _, patt in ipairs(filter.excludes) do if filename:find(patt) then goto continue end end
+		-- Treat inclusive patterns as logical OR.
+		if not include then
+			for _, patt in ipairs(filter) do
+				if filename:find(patt) then
+					include = true
+					break
+				end
+			end
 		end
 		if not include then goto continue end
 		local os_filename = not WIN32 and filename or filename:gsub('/', sep)
@@ -82,8 +87,11 @@ function lfs.walk(dir, filter, n, include_dirs)
 	-- Process the given filter into something that can match files more easily and/or quickly. For
 	-- example, convert '.ext' shorthand to '%.ext$', substitute '/' with '[/\\]', and enable
 	-- hash lookup for file extensions to include or exclude.
+	-- Exclusive patterns are stored separately (without their leading '!') so they do not have
+	-- to be distinguished from inclusive ones for every path walked.
 	local processed_filter = {
-		consider_any = true, exts = setmetatable({}, {__index = function() return true end})
+		consider_any = true, exts = setmetatable({}, {__index = function() return true end}),
+		excludes = {}
 	}
 	for _, patt in ipairs(type(filter) == 'table' and filter or {filter}) do
 		patt = patt:gsub('[.+%()-]', '%%%0'):gsub('%?', '.'):gsub('%*', '.-')
@@ -93,9 +101,11 @@ function lfs.walk(dir, filter, n, include_dirs)
 		if ext then
 			processed_filter.exts[ext] = include
 			if include then setmetatable(processed_filter.exts, nil) end
-		else
-			if include then processed_filter.consider_any = false end
+		elseif include then
+			processed_filter.consider_any = false
 			processed_filter[#processed_filter + 1] = patt
+		else
+			processed_filter.excludes[#processed_filter.excludes + 1] = patt:sub(2)
 		end
 	end
 	local co = coroutine.create(function() walk(dir, processed_filter, n, include_dirs) end)
@@ -0,0 +1,46 @@
+-- Copyright 2007-2023 Mitchell. See LICENSE.
+
+--- Reports profiling results when Textadept is started with the '-P' or '--profile' command
+-- line option.
+-- Textadept records the time spent in each phase of startup, in each event and each of its
+-- handlers, in timeout functions, in spawned process output callbacks, and in calls to
+-- Scintilla. Times are inclusive, so time spent in an event emitted by another event counts
+-- toward both.
+-- This module extends the `_PROFILE` table defined in C, which only exists while profiling.
+local M = _PROFILE
+
+--- Prints profiling results to a "[Profile]" buffer, with the most time-consuming entries first.
+function M.report()
+	local entries = {}
+	for name, stat in pairs(M.stats) do entries[#entries + 1] = {name, stat} end
+	table.sort(entries, function(a, b) return a[2].total > b[2].total end)
+	local lines = {string.format('%-70s %8s %12s %12s', 'Name', 'Calls', 'Total (ms)', 'Max (ms)')}
+	for _, entry in ipairs(entries) do
+		local name, stat = entry[1], entry[2]
+		lines[#lines + 1] = string.format('%-70s %8d %12.3f %12.3f', name, stat.count,
+			stat.total * 1000, stat.max * 1000)
+	end
+	ui.print_to('[Profile]', table.concat(lines, '\n'))
+end
+
+--- Writes the recorded profiling timeline to file *filename* in the Chrome trace event format.
+-- @param filename The filename to write to.
+function M.write_trace(filename)
+	local f = assert(io.open(assert_type(filename, 'string', 1), 'wb'))
+	f:write('{"traceEvents":[')
+	for i, call in ipairs(M.trace) do
+		local name = call[1]:gsub('[\\"]', '\\%0'):gsub('%c',
+			function(c) return string.format('\\u%04x', c:byte()) end)
+		f:write(i > 1 and ',\n' or '\n', string.format(
+			'{"name":"%s","ph":"X","ts":%.0f,"dur":%.0f,"pid":1,"tid":1}', name, call[2] * 1e6,
+			call[3] * 1e6))
+	end
+	f:write('\n]}\n'):close()
+end
+
+-- Show startup results once Textadept has finished initializing, and write out the timeline
+-- on quit.
+events.connect(events.INITIALIZED, function()
+	if not (CURSES and WIN32) then timeout(0.01, M.report) end -- after startup is recorded
+end)
+events.connect(events.QUIT, function() M.write_trace(_USERHOME .. '/profile.json') end, 1)
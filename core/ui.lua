@@ -45,6 +45,13 @@ if CURSES then ui.tabs = false end -- not supported right now
 -- The default value is `true`.
 ui.buffer_list_zorder = true
 
+--- The maximum number of lines print buffers like the message buffer and output buffer may
+-- contain.
+-- When printing exceeds this limit, the oldest tenth of those lines is removed. `0` means
+-- there is no limit. Print buffers do not record undo history.
+-- The default value is `100000`.
+ui.print_max_lines = 100000
+
 --- Helper function for getting the print view.
 local function get_print_view(type)
 	for _, view in ipairs(_VIEWS) do if view.buffer._type == type then return view end end
@@ -69,7 +76,7 @@ local function print_to(buffer_type, silent, format, ...)
 		if not buffer then
 			local prev_buffer = _G.buffer
 			buffer = _G.buffer.new()
-			buffer._type = buffer_type
+			buffer._type, buffer.undo_collection = buffer_type, false
 			if silent then view:goto_buffer(prev_buffer) end
 		else
 			view:goto_buffer(buffer)
@@ -77,11 +84,15 @@ local function print_to(buffer_type, silent, format, ...)
 	elseif print_view and not silent then
 		ui.goto_view(print_view)
 	end
-	local prev_line_count = buffer.line_count
 	local args = table.pack(...)
 	for i = 1, args.n do args[i] = tostring(args[i]) end
-	buffer:append_text(table.concat(args, format and '\t' or ''))
-	if format then buffer:append_text('\n') end
+	local text = table.concat(args, format and '\t' or '')
+	buffer:append_text(format and text .. '\n' or text) -- append once
+	local max = ui.print_max_lines
+	if max > 0 and buffer.line_count > max then
+		local excess = buffer.line_count - (max - max // 10)
+		buffer:delete_range(1, buffer:position_from_line(excess + 1) - 1)
+	end
 	buffer:goto_pos(buffer.length + 1)
 	buffer:set_save_point()
 	for _, view in ipairs(_VIEWS) do
@@ -500,3 +511,16 @@ events.connect(events.INITIALIZED, function() events.disconnect(events.ERROR, te
 -- Emits `events.SUSPEND` and `events.RESUME`.
 -- @usage keys['ctrl+z'] = ui.suspend
 -- @function suspend
+
+--- Returns a table of memory usage statistics, for sizing long-running sessions.
+-- The table has 3 fields:
+--
+-- - `lua`: Table of Lua memory usage, with the total bytes in use by Lua in `heap`, the bytes
+--	reserved for small Lua objects in `pool`, and the reserved bytes that are unused in
+--	`pool_free`.
+-- - `buffers`: List of buffer memory usage, in `_BUFFERS` order. Each entry has the `buffer`
+--	itself, the bytes of its `text` and `styles`, and its number of `lines`.
+-- - `processes`: List of spawned process memory usage. Each entry has the bytes of `stdout`
+--	and `stderr` output that are pending delivery, and the bytes `reserved` for them.
+-- @usage ui.print(ui.memory_stats().lua.heap)
+-- @function memory_stats
@@ -171,6 +171,7 @@ view.indentation_guides = not CURSES and view.IV_LOOKBOTH or view.IV_NONE
 view:marker_define(textadept.bookmarks.MARK_BOOKMARK, view.MARK_FULLRECT)
 view:marker_define(textadept.run.MARK_WARNING, view.MARK_FULLRECT)
 view:marker_define(textadept.run.MARK_ERROR, view.MARK_FULLRECT)
+view:marker_define(textadept.history.MARK_HISTORY, view.MARK_EMPTY)
 -- Arrow Folding Symbols.
 -- view:marker_define(view.MARKNUM_FOLDEROPEN, view.MARK_ARROWDOWN)
 -- view:marker_define(view.MARKNUM_FOLDER, view.MARK_ARROW)
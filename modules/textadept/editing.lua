@@ -4,6 +4,8 @@
 -- @module textadept.editing
 local M = {}
 
+local matches = require('textadept.matches')
+
 --- Match the previous line's indentation level after inserting a new line.
 -- The default value is `true`.
 M.auto_indent = true
@@ -13,7 +15,8 @@ M.auto_indent = true
 M.strip_trailing_spaces = false
 
 --- Autocomplete the current word using words from all open buffers.
--- If `true`, performance may be slow when many buffers are open.
+-- If `true`, the first autocompletion may be slow when many buffers are open, since each of
+-- their word indices must be built.
 -- The default value is `false`.
 M.autocomplete_all_words = false
 
@@ -156,10 +159,7 @@ events.connect(events.UPDATE_UI, function(updated)
 end)
 
 --- Clears highlighted word indicators.
-local function clear_highlighted_words()
-	buffer.indicator_current = M.INDIC_HIGHLIGHT
-	buffer:indicator_clear_range(1, buffer.length)
-end
+local function clear_highlighted_words() matches.clear(M.INDIC_HIGHLIGHT) end
 events.connect(events.KEYPRESS, function(key)
 	if key == 'esc' then clear_highlighted_words() end
 end, 1)
@@ -183,12 +183,7 @@ events.connect(events.UPDATE_UI, function(updated)
 	else
 		return
 	end
-	buffer.search_flags = buffer.FIND_MATCHCASE | buffer.FIND_WHOLEWORD
-	buffer:target_whole_document()
-	while buffer:search_in_target(word) ~= -1 do
-		buffer:indicator_fill_range(buffer.target_start, buffer.target_end - buffer.target_start)
-		buffer:set_target_range(buffer.target_end, buffer.length + 1)
-	end
+	matches.highlight(M.INDIC_HIGHLIGHT, word, buffer.FIND_MATCHCASE | buffer.FIND_WHOLEWORD)
 end)
 
 -- Moves over auto-paired complement characters when typed, taking multiple selections into
@@ -225,7 +220,8 @@ end)
 
 -- Enables and disables bracketed paste mode in curses and disables auto-pair and auto-indent
 -- while pasting.
-if CURSES and not WIN32 then
+-- Batch mode has no terminal to send escape sequences to.
+if CURSES and not WIN32 and not args._batch then
 	local function enable_br_paste() io.stdout:write('\x1b[?2004h'):flush() end
 	local function disable_br_paste() io.stdout:write('\x1b[?2004l'):flush() end
 	enable_br_paste()
@@ -506,6 +502,22 @@ function M.convert_indentation()
 	buffer:end_undo_action()
 end
 
+--- The number of bytes of text to pass to or read from a filter command at a time.
+local FILTER_CHUNK_SIZE = 0x10000
+
+--- Returns a script that runs shell command *command* with stdin and stdout redirected from
+-- and to files *input* and *output*.
+-- The shell connects the stages of any pipeline, runs them concurrently, and reports the
+-- first non-zero exit status (where supported).
+local function filter_script(command, input, output)
+	if WIN32 then
+		return string.format('@(%s\r\n) < "%s" > "%s" 2> NUL\r\n', (command:gsub('%%', '%%%%')),
+			input, output)
+	end
+	return string.format("(set -o pipefail) 2> /dev/null && set -o pipefail\n" ..
+		"(%s\n) < '%s' > '%s' 2> /dev/null\n", command, input, output)
+end
+
 --- Passes the selected text or all buffer text to string shell command *command* as standard input
 -- (stdin) and replaces the input text with the command's standard output (stdout). *command*
 -- may contain shell pipes ('|').
@@ -519,10 +531,13 @@ end
 --	only the line ending delimiters from the previous line are included. The rest of the
 --	line is excluded.
 --
--- Note: Be careful when using commands that emit stdout while reading stdin (as opposed
--- to emitting stdout only after stdin is closed). Input that generates more output
--- than an OS-specific pipe can hold may hang Textadept. On Linux, this may be 64K. See
--- `spawn_proc:write()`.
+-- Input and output are streamed through temporary files rather than held in memory, and the
+-- shell runs all commands in a pipeline concurrently, so large amounts of text can be filtered.
+-- Textadept waits for *command* to finish.
+--
+-- *command* is interpreted by the shell (`sh` on Linux and macOS, `cmd.exe` on Windows), not
+-- split into arguments like `os.spawn()` commands are. Quoting, variable expansion, globbing,
+-- and redirection therefore follow that shell's rules.
 -- @param command The Linux, macOS, or Windows shell command to filter text through. May
 --	contain pipes.
 function M.filter_through(command)
@@ -541,52 +556,112 @@ function M.filter_through(command)
 		end
 		buffer:set_target_range(s, e)
 	end
-	local commands = lpeg.match(lpeg.Ct(lpeg.P{
-		lpeg.C(lpeg.V('command')) * ('|' * lpeg.C(lpeg.V('command')))^0, --
-		command = (1 - lpeg.S('"\'|') + lpeg.V('str'))^1, --
-		str = '"' * (1 - lpeg.S('"\\') + lpeg.P('\\') * 1)^0 * lpeg.P('"')^-1 +
-			("'" * (1 - lpeg.S("'\\") + lpeg.P('\\') * 1)^0 * lpeg.P("'")^-1)
-	}), command)
-	local inout = buffer.selections == 1 and buffer.target_text or {}
-	if buffer.selections > 1 then
-		-- Use selected text as input.
-		for i = 1, buffer.selections do
-			inout[#inout + 1] = buffer:text_range(buffer.selection_n_start[i], buffer.selection_n_end[i])
-		end
-		inout = table.concat(inout, '\n') .. '\n'
+
+	local input, output, script = os.tmpname(), os.tmpname(), os.tmpname()
+	local function remove_temp_files()
+		os.remove(input)
+		os.remove(script)
+		if WIN32 then os.remove(script:sub(1, -5)) end
 	end
-	for i = 1, #commands do
-		local p = assert(os.spawn(commands[i]:match('^%s*(.-)%s*$')))
-		p:write(inout)
+	if WIN32 then script = script .. '.bat' end
+	local ok, status = pcall(function()
+		-- Write input, a chunk at a time.
+		local f = assert(io.open(input, 'wb'))
+		if buffer.selections == 1 then
+			for pos = buffer.target_start, buffer.target_end - 1, FILTER_CHUNK_SIZE do
+				f:write(buffer:text_range(pos, math.min(pos + FILTER_CHUNK_SIZE, buffer.target_end)))
+			end
+		else
+			-- Use selected text as input.
+			for i = 1, buffer.selections do
+				f:write(buffer:text_range(buffer.selection_n_start[i], buffer.selection_n_end[i]), '\n')
+			end
+		end
+		f:close()
+
+		-- Run the command.
+		assert(io.open(script, 'wb')):write(filter_script(command, input, output)):close()
+		local p = assert(os.spawn(not WIN32 and string.format("sh '%s'", script) or
+			string.format('"%s"', script)))
 		p:close()
-		inout = p:read('a') or ''
-		if p:wait() ~= 0 then
-			ui.statusbar_text = string.format('"%s" %s', commands[i], _L['returned non-zero status'])
-			return
+		return p:wait()
+	end)
+	remove_temp_files()
+	if not ok then
+		os.remove(output)
+		error(status, 0)
+	end
+	local f = io.open(output, 'rb')
+	if status ~= 0 or not f then
+		ui.statusbar_text = string.format('"%s" %s', command, _L['returned non-zero status'])
+		if f then f:close() end
+		os.remove(output)
+		return
+	end
+
+	-- Read output, a chunk at a time if possible.
+	local chunks = f:lines(FILTER_CHUNK_SIZE)
+	if _CHARSET ~= 'UTF-8' or buffer.selections > 1 then
+		local output = f:read('a'):iconv('UTF-8', _CHARSET)
+		chunks = function()
+			local chunk = output
+			output = nil
+			return chunk ~= '' and chunk or nil
 		end
 	end
-	inout = inout:iconv('UTF-8', _CHARSET)
 	if buffer.selections == 1 then
-		if buffer:get_text() == inout then return end -- do not perform no-op
-		buffer:replace_target(inout)
+		-- Do not perform a no-op.
+		local size, same = f:seek('end'), false
+		if size == buffer.target_end - buffer.target_start and _CHARSET == 'UTF-8' then
+			f:seek('set')
+			same = true
+			for pos = buffer.target_start, buffer.target_end - 1, FILTER_CHUNK_SIZE do
+				local chunk_end = math.min(pos + FILTER_CHUNK_SIZE, buffer.target_end)
+				if f:read(chunk_end - pos) ~= buffer:text_range(pos, chunk_end) then
+					same = false
+					break
+				end
+			end
+		end
+		f:seek('set')
+		if same then
+			f:close()
+			os.remove(output)
+			return
+		end
+		buffer:begin_undo_action()
+		buffer:replace_target('')
+		local start = buffer.target_start
+		local pos = start
+		for chunk in chunks do
+			buffer:insert_text(pos, chunk)
+			pos = pos + #chunk
+		end
+		buffer:end_undo_action()
+		buffer:set_target_range(start, pos)
 		view.first_visible_line = top_line
 		if s == e then buffer.target_start, buffer.target_end = s, s end
 		buffer:set_sel(buffer.target_start, buffer.target_end)
-	elseif buffer.selection_is_rectangle then
-		local anchor, pos = buffer.rectangular_selection_anchor, buffer.rectangular_selection_caret
-		buffer:replace_rectangular(inout)
-		buffer.rectangular_selection_anchor, buffer.rectangular_selection_caret = anchor, pos
 	else
-		local lines = {}
-		for line in inout:gmatch('[^\r\n]*') do lines[#lines + 1] = line end
-		buffer:begin_undo_action()
-		for i = 1, buffer.selections do
-			buffer:set_target_range(buffer.selection_n_start[i], buffer.selection_n_end[i])
-			buffer:replace_target(lines[i] or '')
-			buffer.selection_n_end[i] = buffer.selection_n_start[i] + #(lines[i] or '')
+		local inout = chunks() or ''
+		if buffer.selection_is_rectangle then
+			local anchor, pos = buffer.rectangular_selection_anchor, buffer.rectangular_selection_caret
+			buffer:replace_rectangular(inout)
+			buffer.rectangular_selection_anchor, buffer.rectangular_selection_caret = anchor, pos
+		else
+			local lines = {}
+			for line in inout:gmatch('[^\r\n]*') do lines[#lines + 1] = line end
+			buffer:begin_undo_action()
+			for i = 1, buffer.selections do
+				buffer:set_target_range(buffer.selection_n_start[i], buffer.selection_n_end[i])
+				buffer:replace_target(lines[i] or '')
+				buffer.selection_n_end[i] = buffer.selection_n_start[i] + #(lines[i] or '')
+			end
+			buffer:end_undo_action()
 		end
-		buffer:end_undo_action()
 	end
+	f:close()
+	os.remove(output)
 end
 
 --- Displays an autocompletion list provided by the autocompleter function associated with string
@@ -607,10 +682,73 @@ function M.autocomplete(name)
 	return buffer:auto_c_active() or buffer.auto_c_choose_single and buffer.current_pos ~= pos
 end
 
+--- Map of buffers to the word indices used by the word autocompleter.
+-- Each index has a *counts* table that maps words to their number of occurrences, a *prefixes*
+-- table that maps the lower-case first two bytes of words to sets of those words, the *patt*
+-- for matching words given the *word_chars* the index was built with, and the buffer's *edits*
+-- count as of the index's last update. The latter is used to detect changes made while the
+-- buffer's modifications were not being watched (e.g. while it was in the background), since
+-- that count is incremented for every insertion and deletion, even ones Lua is not notified of.
+local word_indices = setmetatable({}, {__mode = 'k'})
+
+--- Adds the words in the given text to the given word index, or removes them if *delta* is -1.
+local function index_words(index, text, delta)
+	local counts, prefixes = index.counts, index.prefixes
+	for word in text:gmatch(index.patt) do
+		local prev = counts[word] or 0
+		local count = math.max(prev + delta, 0)
+		counts[word] = count > 0 and count or nil
+		if #word > 1 and (prev == 0) ~= (count == 0) then
+			local prefix = word:sub(1, 2):lower()
+			if not prefixes[prefix] then prefixes[prefix] = {} end
+			prefixes[prefix][word] = count > 0 or nil
+		end
+	end
+end
+
+--- Returns the number of insertions and deletions made in the given buffer so far.
+local function get_edits(buffer) return rawget(buffer, '_edits') or 0 end
+
+--- Returns the given buffer's word index, (re)building it if necessary.
+local function get_word_index(buffer)
+	local index = word_indices[buffer]
+	if index and index.edits == get_edits(buffer) and index.word_chars == buffer.word_chars then
+		return index
+	end
+	index = {counts = {}, prefixes = {}, word_chars = buffer.word_chars}
+	index.patt = '[' .. index.word_chars:gsub('%W', '%%%0') .. ']+'
+	index_words(index, buffer:get_text(), 1)
+	index.edits, word_indices[buffer] = get_edits(buffer), index
+	return index
+end
+
+-- Keeps the current buffer's word index up-to-date by removing the words around a change
+-- before it happens, and then adding back the words around it afterwards. Indices are dropped
+-- for large changes and rebuilt on demand, since that is faster.
+local BEFORE_INSERT, BEFORE_DELETE = _SCINTILLA.constants.MOD_BEFOREINSERT,
+	_SCINTILLA.constants.MOD_BEFOREDELETE
+local INSERT, DELETE = _SCINTILLA.constants.MOD_INSERTTEXT, _SCINTILLA.constants.MOD_DELETETEXT
+local MAX_INDEXED_CHANGE = 65536
+events.connect(events.MODIFIED, function(position, mod, text, length)
+	local index = word_indices[buffer]
+	if not index or mod & (BEFORE_INSERT | BEFORE_DELETE | INSERT | DELETE) == 0 then return end
+	local before = mod & (BEFORE_INSERT | BEFORE_DELETE) > 0
+	if before and (index.edits ~= get_edits(buffer) or length > MAX_INDEXED_CHANGE) then
+		word_indices[buffer] = nil
+		return
+	end
+	local e = mod & (BEFORE_DELETE | INSERT) > 0 and position + length or position
+	index_words(index, buffer:text_range(buffer:word_start_position(position, true),
+		buffer:word_end_position(e, true)), before and -1 or 1)
+	if not before then index.edits = get_edits(buffer) end
+end)
+
 --- Returns for the word part behind the caret a list of whole word completions
 -- constructed from the current buffer or all open buffers (depending on
 -- `textadept.editing.autocomplete_all_words`).
 -- If `buffer.auto_c_ignore_case` is `true`, completions are not case-sensitive.
+-- Completions come from per-buffer word indices that are kept up-to-date as buffers change,
+-- so the time taken depends on the number of candidate words rather than the size of buffers.
 -- @see buffer.word_chars
 -- @see autocomplete
 -- @function _G.textadept.editing.autocompleters.word
@@ -619,18 +757,27 @@ M.autocompleters.word = function()
 	local s = buffer:word_start_position(buffer.current_pos, true)
 	if s == buffer.current_pos then return end
 	local word_part = buffer:text_range(s, buffer.current_pos)
+	local ignore_case = buffer.auto_c_ignore_case
+	local part = ignore_case and word_part:lower() or word_part
+	local prefix = word_part:sub(1, 2):lower()
+	-- Adds to the list the words in the given set that complete the word part.
+	local function add_matches(words)
+		for word in pairs(words) do
+			if #word > #part and not matches[word] and
+				(ignore_case and word:lower() or word):sub(1, #part) == part then
+				list[#list + 1], matches[word] = word, true
+			end
+		end
+	end
 	for _, buffer in ipairs(_BUFFERS) do
 		if buffer == _G.buffer or M.autocomplete_all_words then
-			buffer.search_flags = buffer.FIND_WORDSTART |
-				(not _G.buffer.auto_c_ignore_case and buffer.FIND_MATCHCASE or 0)
-			buffer:target_whole_document()
-			while buffer:search_in_target(word_part) ~= -1 do
-				local e = buffer:word_end_position(buffer.target_end, true)
-				local match = buffer:text_range(buffer.target_start, e)
-				if #match > #word_part and not matches[match] then
-					list[#list + 1], matches[match] = match, true
+			local prefixes = get_word_index(buffer).prefixes
+			if #prefix > 1 then
+				if prefixes[prefix] then add_matches(prefixes[prefix]) end
+			else
+				for key, words in pairs(prefixes) do
+					if key:sub(1, 1) == prefix then add_matches(words) end
 				end
-				buffer:set_target_range(e, buffer.length + 1)
 			end
 		end
 	end
@@ -4,6 +4,8 @@
 -- @module ui.find
 local M = ui.find
 
+local matches = require('textadept.matches')
+
 --- The text in the "Find" entry.
 -- @field find_entry_text
 
@@ -164,10 +166,7 @@ end
 local function is_ff_buf(buf) return buf._type == _L['[Files Found Buffer]'] end
 
 --- Clears highlighted match indicators.
-local function clear_highlighted_matches()
-	buffer.indicator_current = M.INDIC_FIND
-	buffer:indicator_clear_range(1, buffer.length)
-end
+local function clear_highlighted_matches() matches.clear(M.INDIC_FIND) end
 events.connect(events.KEYPRESS, function(key)
 	if key ~= 'esc' or is_ff_buf(buffer) then return end
 	clear_highlighted_matches()
@@ -249,18 +248,9 @@ events.connect(events.FIND_TEXT_CHANGED, function()
 end)
 events.connect(events.FIND_RESULT_FOUND, function(text, wrapped)
 	-- Count and optionally highlight all occurrences.
-	local count, current = 0, 1
-	buffer.search_flags = get_flags()
-	buffer:target_whole_document()
-	while buffer:search_in_target(text) ~= -1 do
-		local s, e = buffer.target_start, buffer.target_end
-		if s == e then e = e + 1 end -- prevent loops for zero-length results
-		if M.highlight_all_matches and e - s > 1 and not is_ff_buf(buffer) then
-			buffer:indicator_fill_range(s, e - s)
-		end
-		buffer:set_target_range(e, buffer.length + 1)
-		count = count + 1
-		if s == buffer.current_pos then current = count end
+	local count, current = matches.count(text, get_flags(), buffer.current_pos)
+	if M.highlight_all_matches and not is_ff_buf(buffer) then
+		matches.highlight(M.INDIC_FIND, text, get_flags(), 2)
 	end
 	local message = string.format('%s %d/%d', _L['Match'], current, count)
 	if wrapped then message = string.format('%s (%s)', message, _L['Search wrapped']) end
@@ -341,13 +331,26 @@ function M.find_in_files(dir, filter)
 	buffer.code_page = 0 -- default is UTF-8
 	buffer.search_flags = get_flags()
 	local text, i, found, show_names = M.find_entry_text, 1, false, M.show_filenames_in_progressbar
+	local may_match = {} -- whether or not each file might contain non-regex search text
 	stopped = ui.dialogs.progress{
 		title = string.format('%s: %s', _L['Find in Files']:gsub('[_&]', ''), text),
 		text = show_names and utf8_filenames[i], work = function()
+			-- Rule out files that cannot contain matches in blocks, reading them on worker threads.
+			-- This is much faster than copying each file into a buffer and searching there.
+			if not M.regex and may_match[i] == nil then
+				local block = table.move(filenames, i, math.min(i + 999, #filenames), 1, {})
+				table.move(io._may_contain(block, text, M.match_case), 1, #block, i, may_match)
+			end
+			if may_match[i] == false then
+				repeat i = i + 1 until may_match[i] ~= false
+				if i > #filenames then return nil end
+				return i * 100 / #filenames, show_names and utf8_filenames[i] or nil
+			end
 			local f = io.open(filenames[i], 'rb')
-			buffer:target_whole_document()
-			buffer:replace_target(f:read('a'))
+			local contents = f:read('a')
 			f:close()
+			buffer:target_whole_document()
+			buffer:replace_target(contents)
 			local binary = nil -- determine lazily for performance reasons
 			buffer:target_whole_document()
 			while buffer:search_in_target(text) ~= -1 do
@@ -415,43 +418,96 @@ events.connect(events.REPLACE, function(text)
 	buffer:set_sel(buffer.target_start, buffer.target_end)
 end)
 
-local INDIC_REPLACE = _SCINTILLA.new_indic_number()
+--- Returns regex replacement text *text* as a list of literal strings and capture numbers if
+-- it can be expanded for each match without `unescape()` (i.e. it has no case conversions),
+-- or `nil` otherwise.
+-- @param text String replacement text.
+local function compile_replacement(text)
+	text = text:gsub('%f[\\]\\u(%x%x%x%x)', function(code) return utf8.char(tonumber(code, 16)) end)
+	if text:find('\\[uUlLE]') then return nil end
+	local parts, pos = {}, 1
+	for s, d, e in text:gmatch('()\\(%d)()') do
+		parts[#parts + 1], parts[#parts + 2] = re_patt:match(text:sub(pos, s - 1)) or '', tonumber(d)
+		pos = e
+	end
+	parts[#parts + 1] = re_patt:match(text:sub(pos)) or ''
+	return parts
+end
+
+--- Returns the replacement text for the current regex match (the target) given replacement
+-- parts from `compile_replacement()`.
+local function expand_replacement(parts)
+	local text = {}
+	for i = 1, #parts do
+		local part = parts[i]
+		text[i] = type(part) == 'string' and part or part == 0 and buffer.target_text or
+			buffer.tag[part]
+	end
+	return table.concat(text)
+end
+
 -- Replaces all found text in the current buffer (ignores "Find in Files").
 -- If any text is selected (other than text just found), only found text in that selection
 -- is replaced.
+-- All matches are found first, and then they are replaced from last to first in a single undo
+-- action, so no match's position needs adjusting for the replacements before it. Only the
+-- matched text is replaced, so markers and indicators between matches are left alone. This
+-- means each match is still its own buffer modification (and `events.MODIFIED` notification);
+-- replacing the span of all matches at once would remove everything between them.
 events.connect(events.REPLACE_ALL, function(ftext, rtext)
 	if ftext == '' then return end
 	repl_text = rtext -- save for ui.find.focus()
-	local count = 0
 	local replace_in_sel = not buffer.selection_empty and
 		(ftext ~= find_text or buffer:get_sel_text() ~= found_text)
-	if replace_in_sel then buffer.indicator_current = INDIC_REPLACE end
-
-	for i = 1, buffer.selections do
-		local s, e = buffer.selection_n_start[i], buffer.selection_n_end[i]
-		if replace_in_sel then buffer:indicator_fill_range(e, 1) end
-		local EOF = replace_in_sel and e == buffer.length + 1 -- no indicator at EOF
-
-		-- Perform the search and replace.
-		buffer:begin_undo_action()
-		buffer.search_flags = get_flags()
-		buffer:set_target_range(not replace_in_sel and 1 or s, buffer.length + 1)
-		while buffer:search_in_target(ftext) ~= -1 and
-			(not replace_in_sel or buffer.target_end <= buffer:indicator_end(INDIC_REPLACE, s) or EOF) do
-			local offset = buffer.target_start ~= buffer.target_end and 0 or 1 -- for preventing loops
+	local ranges = {}
+	for i = 1, replace_in_sel and buffer.selections or 1 do
+		ranges[i] = not replace_in_sel and {1, buffer.length + 1} or
+			{buffer.selection_n_start[i], buffer.selection_n_end[i]}
+	end
+	local sorted = table.move(ranges, 1, #ranges, 1, {})
+	table.sort(sorted, function(a, b) return a[1] < b[1] end)
+
+	-- Find all matches and their replacements.
+	local starts, ends, replacements = {}, {}, {}
+	local parts = M.regex and compile_replacement(rtext)
+	buffer.search_flags = get_flags()
+	for _, range in ipairs(sorted) do
+		local s, e = range[1], range[2]
+		buffer:set_target_range(math.max(s, ends[#ends] or 1), buffer.length + 1)
+		while buffer:search_in_target(ftext) ~= -1 and (not replace_in_sel or buffer.target_end <= e) do
+			local n = #starts + 1
+			starts[n], ends[n] = buffer.target_start, buffer.target_end
+			replacements[n] = not M.regex and rtext or parts and expand_replacement(parts) or
+				unescape(rtext)
+			local offset = starts[n] ~= ends[n] and 0 or 1 -- for preventing loops
 			if M.regex and ftext:find('^^') and offset == 0 then offset = 1 end -- avoid extra matches
-			buffer:replace_target(not M.regex and rtext or unescape(rtext))
-			count = count + 1
-			buffer:set_target_range(buffer.target_end + offset, buffer.length + 1)
+			if ends[n] + offset > buffer.length + 1 then break end
+			buffer:set_target_range(ends[n] + offset, buffer.length + 1)
 		end
-		buffer:end_undo_action()
+	end
 
-		-- Restore any original selection.
-		if replace_in_sel then
-			e = buffer:indicator_end(INDIC_REPLACE, s)
-			buffer.selection_n_start[i], buffer.selection_n_end[i] = s, e > 1 and e or buffer.length + 1
-			if e > 1 then buffer:indicator_clear_range(e, 1) end
+	-- Perform the replacement.
+	local count = #starts
+	buffer:begin_undo_action()
+	for i = count, 1, -1 do
+		buffer:set_target_range(starts[i], ends[i])
+		buffer:replace_target(replacements[i])
+	end
+	buffer:end_undo_action()
+
+	-- Restore any original selections.
+	if replace_in_sel then
+		-- Returns the given position adjusted for any replacements before it.
+		local function adjust(pos)
+			local delta = 0
+			for i = 1, count do
+				if ends[i] > pos then break end
+				delta = delta + #replacements[i] - (ends[i] - starts[i])
+			end
+			return pos + delta
 		end
+		buffer:set_selection(adjust(ranges[1][2]), adjust(ranges[1][1]))
+		for i = 2, #ranges do buffer:add_selection(adjust(ranges[i][2]), adjust(ranges[i][1])) end
 	end
 
 	ui.statusbar_text = string.format('%d %s', count, _L['replacement(s) made'])
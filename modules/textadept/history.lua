@@ -4,12 +4,18 @@
 -- that history.
 --
 -- This module listens for text edit events and buffer switch events. Each time an insertion
--- or deletion occurs, its location is recorded in the current view's location history. If the
--- edit is close enough to the previous record, the previous record is amended. Each time a
--- buffer switch occurs, the before and after locations are also recorded.
+-- or deletion occurs, its location is recorded in the current view's location history. Edits
+-- are recorded in bulk, once per user action or undo action, rather than once per insertion
+-- or deletion. If the edit is close enough to the previous record, the previous record is
+-- amended. Each time a buffer switch occurs, the before and after locations are also recorded.
+-- Records in open buffers are tracked by markers, so their lines shift as text is edited.
 -- @module textadept.history
 local M = {}
 
+--- The history mark number.
+-- History markers are invisible, and only track the lines of history records.
+M.MARK_HISTORY = _SCINTILLA.new_marker_number()
+
 --- The minimum number of lines between distinct history records.
 -- The default value is `3`.
 M.minimum_line_distance = 3
@@ -29,19 +35,92 @@ local view_history = setmetatable({}, {
 	end
 })
 
+--- Returns the line of the given history record.
+-- If the record's buffer is open, this is the line of the record's marker, which shifts as text
+-- is edited. Checking the record's last known line first avoids searching for the marker.
+local function get_line(record)
+	local buffer, handle = record.buffer, record.handle
+	if not handle or not _BUFFERS[buffer] then return record.line end
+	local i, line_handle = 1, buffer:marker_handle_from_line(record.line, 1)
+	while line_handle ~= -1 and line_handle ~= handle do
+		i = i + 1
+		line_handle = buffer:marker_handle_from_line(record.line, i)
+	end
+	if line_handle == -1 then -- the marker moved
+		local line = buffer:marker_line_from_handle(handle)
+		if line ~= -1 then record.line = line else record.handle = nil end
+	end
+	return record.line
+end
+
+--- Removes the given history record's marker, if any.
+local function remove_marker(record)
+	if record.handle and _BUFFERS[record.buffer] then
+		record.buffer:marker_delete_handle(record.handle)
+	end
+	record.handle = nil
+end
+
+--- Sets the line of the given history record, moving its marker if it is in the current buffer.
+local function set_line(record, line)
+	remove_marker(record)
+	record.line = line
+	if record.buffer == buffer then
+		local handle = buffer:marker_add(line, M.MARK_HISTORY)
+		if handle ~= -1 then record.handle = handle end
+	end
+end
+
+--- Calls function *f* with each history record in the current buffer.
+local function each_buffer_record(f)
+	for _, history in pairs(view_history) do
+		for _, record in ipairs(history) do if record.buffer == buffer then f(record) end end
+	end
+end
+
+--- The position of the most recent edit that has not been recorded yet, along with the buffer
+-- and view it was made in.
+local edit_pos, edit_buffer, edit_view
+
+--- Records the location of the most recent edit, if it has not been recorded yet.
+-- During multiple selection edits, the main selection's location is recorded.
+local function record_edit()
+	if not edit_pos then return end
+	local pos = edit_pos
+	edit_pos = nil
+	if buffer ~= edit_buffer or view ~= edit_view then return end
+	if buffer.selections > 1 then pos = buffer.current_pos end
+	pos = math.min(pos, buffer.length + 1)
+	M.record(nil, buffer:line_from_position(pos), buffer.column[pos])
+end
+
 local INSERT, DELETE = buffer.MOD_INSERTTEXT, buffer.MOD_DELETETEXT
 local UNDO, REDO = buffer.PERFORMED_UNDO, buffer.PERFORMED_REDO
--- Listens for text insertion and deletion events and records their locations.
+local START_ACTION = buffer.STARTACTION
+-- Listens for text insertion and deletion events and notes their locations. The location of
+-- the most recent edit is only recorded once the next undo action starts or the UI updates,
+-- so large edits like multiple selection typing and Replace All record one location rather
+-- than one per insertion or deletion.
 events.connect(events.MODIFIED, function(position, mod, text, length)
-	if mod & (INSERT | DELETE) == 0 or buffer.length == (mod & INSERT > 0 and length or 0) then
-		return -- ignore non-insertion/deletion, file loading, and replacing buffer contents
+	if mod & (INSERT | DELETE) == 0 then return end -- ignore non-insertion/deletion
+	if edit_pos and edit_buffer == buffer then
+		if mod & INSERT > 0 and position <= edit_pos then
+			edit_pos = edit_pos + length
+		elseif mod & DELETE > 0 and position < edit_pos then
+			edit_pos = math.max(edit_pos - length, position)
+		end
+		-- Buffers without undo history have no undo actions, so each edit is its own action.
+		if mod & START_ACTION > 0 or not buffer.undo_collection then record_edit() end
+	end
+	if buffer.length == (mod & INSERT > 0 and length or 0) then
+		return -- ignore file loading and replacing buffer contents
 	end
-	if mod & INSERT > 0 then position = position + length end
 	if mod & (UNDO | REDO) > 0 then return end -- ignore undo/redo
-	local line, column = buffer:line_from_position(position), buffer.column[position]
-	if buffer.selections > 1 and line ~= buffer:line_from_position(buffer.current_pos) then return end
-	M.record(nil, line, column)
+	edit_pos, edit_buffer, edit_view = mod & INSERT > 0 and position + length or position, buffer,
+		view
 end)
+events.connect(events.UPDATE_UI, record_edit)
+events.connect(events.VIEW_BEFORE_SWITCH, record_edit)
 
 -- Do not record positions during buffer switches when jumping backwards or forwards.
 local jumping = false
@@ -51,7 +130,9 @@ local jumping = false
 local function jump(record)
 	jumping = true
 	local filename = record.filename
-	if lfs.attributes(filename) then
+	if _BUFFERS[record.buffer] then
+		view:goto_buffer(record.buffer)
+	elseif lfs.attributes(filename) then
 		io.open_file(filename)
 	else
 		for _, buffer in ipairs(_BUFFERS) do
@@ -62,18 +143,19 @@ local function jump(record)
 			end
 		end
 	end
-	buffer:goto_pos(buffer:find_column(record.line, record.column))
+	buffer:goto_pos(buffer:find_column(get_line(record), record.column))
 	jumping = false
 end
 
 --- Navigates backwards through the current view's history.
 function M.back()
+	record_edit()
 	local history = view_history[view]
 	if #history == 0 then return end -- nothing to do
 	local record = history[history.pos]
 	local line = buffer:line_from_position(buffer.current_pos)
 	if buffer.filename ~= record.filename and buffer._type ~= record.filename or
-		math.abs(record.line - line) > M.minimum_line_distance then
+		math.abs(get_line(record) - line) > M.minimum_line_distance then
 		-- When navigated away from the most recent record, and if that record is not a soft record,
 		-- jump back to it first, then navigate backwards.
 		if not record.soft then
@@ -90,6 +172,7 @@ end
 
 --- Navigates forwards through the current view's history.
 function M.forward()
+	record_edit()
 	local history = view_history[view]
 	if history.pos == #history then return end -- nothing to do
 	local record = history[history.pos]
@@ -114,23 +197,32 @@ function M.record(filename, line, column, soft)
 		line = buffer:line_from_position(buffer.current_pos)
 	end
 	if not assert_type(column, 'number/nil', 3) then column = buffer.column[buffer.current_pos] end
+	record_edit()
+	local current = filename == (buffer.filename or buffer._type or _L['Untitled']) and buffer or nil
 	local history = view_history[view]
 	if #history > 0 then
 		local record = history[history.pos]
 		if filename == record.filename and
-			(math.abs(record.line - line) <= M.minimum_line_distance or record.soft) then
+			(math.abs(get_line(record) - line) <= M.minimum_line_distance or record.soft) then
 			-- If the most recent record is close enough (distance-wise), or if that record is a soft
 			-- record, update it instead of recording a new one.
-			record.line, record.column = line, column
-			record.soft = soft and record.soft
+			if record.buffer ~= current then remove_marker(record) end
+			record.buffer = current
+			if line ~= record.line or not record.handle then set_line(record, line) end
+			record.column, record.soft = column, soft and record.soft
 			return
 		end
 	end
 	if history.pos < #history then
-		for i = history.pos + 1, #history do history[i] = nil end -- clear forward
+		for i = history.pos + 1, #history do -- clear forward
+			remove_marker(history[i])
+			history[i] = nil
+		end
 	end
-	history[#history + 1] = {filename = filename, line = line, column = column, soft = soft}
-	if #history > M.maximum_history_size then table.remove(history, 1) end
+	local record = {filename = filename, column = column, soft = soft, buffer = current}
+	set_line(record, line)
+	history[#history + 1] = record
+	if #history > M.maximum_history_size then remove_marker(table.remove(history, 1)) end
 	history.pos = #history
 end
 
@@ -140,7 +232,29 @@ events.connect(events.BUFFER_BEFORE_SWITCH, record_switch)
 events.connect(events.BUFFER_AFTER_SWITCH, record_switch)
 events.connect(events.FILE_OPENED, record_switch)
 
+-- Update the lines of records in a buffer being switched away from, since that buffer may be
+-- closing, and its markers would be lost.
+events.connect(events.BUFFER_BEFORE_SWITCH, function() each_buffer_record(get_line) end)
+
+-- Save and restore record markers when replacing buffer text (e.g. buffer:reload(),
+-- textadept.editing.filter_through()), since replacement would move them all to the first line.
+events.connect(events.BUFFER_BEFORE_REPLACE_TEXT, function()
+	each_buffer_record(function(record)
+		get_line(record)
+		remove_marker(record)
+	end)
+end)
+events.connect(events.BUFFER_AFTER_REPLACE_TEXT, function()
+	each_buffer_record(function(record) set_line(record, record.line) end)
+end)
+
 --- Clears all view history.
-function M.clear() for view in pairs(view_history) do view_history[view] = {pos = 0} end end
+function M.clear()
+	edit_pos = nil
+	for view, history in pairs(view_history) do
+		for _, record in ipairs(history) do remove_marker(record) end
+		view_history[view] = {pos = 0}
+	end
+end
 
 return M
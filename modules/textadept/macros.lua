@@ -52,25 +52,85 @@ function M.record()
 	recording = not recording
 end
 
+--- Returns whether or not the given character code is a word character.
+-- Consecutive word characters are inserted at once during playback because `events.CHAR_ADDED`
+-- handlers typically only act on punctuation and whitespace (e.g. auto-pairing and auto-indent).
+-- The unbound `events.KEYPRESS` events between them are skipped as well, so any `events.KEYPRESS`
+-- handlers other than the one for `keys` do not see those keys during playback.
+local function is_word_char(code) return code >= 0x80 or string.char(code):find('^[%w_]$') end
+
+--- Returns whether or not the given key is not bound to a command, and so only types a character.
+local function is_unbound(key)
+	local lang_keys = rawget(keys, buffer.lexer_language)
+	return not keys.mode and #keys.keychain == 0 and not keys[key] and
+		not (type(lang_keys) == 'table' and lang_keys[key])
+end
+
+--- Handler that blocks `events.UPDATE_UI` handlers from running during playback, since the
+-- view is not redrawn until playback finishes anyway.
+local function block_update_ui() return true end
+
+--- Plays the given macro once.
+local function play(macro)
+	local i = 1
+	while i <= #macro do
+		local event = macro[i]
+		if event[1] == events.CHAR_ADDED then
+			-- Coalesce a run of word characters and the unbound keypresses that typed them into a
+			-- single insertion, and only emit the event for the last character.
+			local chars, j = {utf8.char(event[2])}, i
+			while is_word_char(macro[j][2]) do
+				local k = j + 1
+				local next_event = macro[k]
+				if next_event and next_event[1] == events.KEYPRESS and is_unbound(next_event[2]) then
+					k, next_event = k + 1, macro[k + 1]
+				end
+				if not next_event or next_event[1] ~= events.CHAR_ADDED or
+					not is_word_char(next_event[2]) then break end
+				j, chars[#chars + 1] = k, utf8.char(next_event[2])
+			end
+			local f = buffer.selection_empty and buffer.add_text or buffer.replace_sel
+			f(buffer, table.concat(chars))
+			event, i = macro[j], j
+		end
+		events.emit(table.unpack(event))
+		i = i + 1
+	end
+end
+
 --- Plays a recorded or previously loaded macro, or loads and plays the macro from file *filename*
 -- if given.
+-- Playback is a single undo action, and the view is updated once playback finishes.
 -- @param[opt] filename Optional filename of a macro to load and play. If the filename is a
 --	relative path, it will be relative to *`_USERHOME`/macros/*.
-function M.play(filename)
+-- @param[optchain=1] n Optional number of times to play the macro. If `0`, the macro is played
+--	repeatedly until the caret reaches the end of the buffer or stops moving towards it.
+function M.play(filename, n)
 	if recording then return end
 	if assert_type(filename, 'string/nil', 1) then M.load(filename) end
+	n = assert_type(n, 'number/nil', 2) or 1
 	if not macro then return end
 	-- If this function is run as a key command, `keys.keychain` cannot be cleared until this
 	-- function returns. Emit 'esc' to forcibly clear it so subsequent keypress events can be
 	-- properly handled.
 	events.emit(events.KEYPRESS, 'esc')
-	for _, event in ipairs(macro) do
-		if event[1] == events.CHAR_ADDED then
-			local f = buffer.selection_empty and buffer.add_text or buffer.replace_sel
-			f(buffer, utf8.char(event[2]))
+	events.connect(events.UPDATE_UI, block_update_ui, 1)
+	buffer:begin_undo_action()
+	local ok, errmsg = pcall(function()
+		local i = 0
+		while n == 0 or i < n do
+			if n == 0 and buffer.current_pos == buffer.length + 1 then break end
+			local lines_left = buffer.line_count - buffer:line_from_position(buffer.current_pos)
+			play(macro)
+			i = i + 1
+			if n == 0 and buffer.line_count - buffer:line_from_position(buffer.current_pos) >=
+				lines_left then break end
 		end
-		events.emit(table.unpack(event))
-	end
+	end)
+	buffer:end_undo_action()
+	events.disconnect(events.UPDATE_UI, block_update_ui)
+	events.emit(events.UPDATE_UI, buffer.UPDATE_CONTENT | buffer.UPDATE_SELECTION)
+	if not ok then error(errmsg, 0) end
 end
 
 --- Returns an absolute path for the given path, relative to `macro_path` if necessary.
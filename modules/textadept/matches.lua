@@ -0,0 +1,223 @@
+-- Copyright 2007-2023 Mitchell. See LICENSE.
+
+-- Searches buffers for all occurrences of text, for highlighting and counting them.
+-- This is used by `textadept.editing` to highlight words and by `ui.find` to highlight and
+-- count matches.
+-- Search results are cached per buffer, search text, and search flags, line by line, so
+-- modifications only invalidate the lines they touch. Highlighting searches the lines visible
+-- in the current view first, and then the rest of the buffer a slice at a time during idle time.
+local M = {}
+
+--- The number of lines to search and highlight at a time during idle time.
+local SLICE_LINES = 5000
+--- The maximum number of search results to cache per buffer.
+local MAX_CACHED = 4
+
+--- Map of buffers to their caches of search results, keyed by search text and flags.
+-- Each set of results has the search *text* and *flags*, the buffer's *line_count* and *edits*
+-- count as of the last update, and a *lines* table that maps line numbers to lists of match
+-- start and end positions relative to the start of that line (or `false` if that line has been
+-- searched and has no matches). Texts that contain newlines, as well as regular expressions
+-- (which may match newlines with escapes like "\n" or "\s"), are *multiline*: their results
+-- are discarded rather than updated when the buffer changes.
+-- The edits count is incremented for every insertion and deletion, even ones Lua is not
+-- notified of, so it detects changes made while the buffer was not being watched.
+local caches = setmetatable({}, {__mode = 'k'})
+
+--- Returns the number of insertions and deletions made in the current buffer so far.
+local function get_edits() return rawget(buffer, '_edits') or 0 end
+
+--- Returns the current buffer's cached results for the given text and search flags.
+local function get_results(text, flags)
+	local cache, key = caches[buffer], flags .. '\0' .. text
+	if not cache or not cache[key] and cache.n >= MAX_CACHED then
+		cache = {n = 0}
+		caches[buffer] = cache
+	end
+	local results = cache[key]
+	if results and results.edits == get_edits() then return results end
+	-- Either the results do not exist or the buffer was changed without being watched.
+	if not results then cache.n = cache.n + 1 end
+	results = {
+		text = text, flags = flags, line_count = buffer.line_count, edits = get_edits(), lines = {},
+		multiline = text:find('[\r\n]') ~= nil or flags & buffer.FIND_REGEXP > 0
+	}
+	cache[key] = results
+	return results
+end
+
+--- Searches lines *first* through *last* for the given results' text, skipping lines that have
+-- already been searched.
+local function search(results, first, last)
+	local lines = results.lines
+	if results.multiline then first, last = 1, buffer.line_count end
+	while first <= last and lines[first] ~= nil do first = first + 1 end
+	while last >= first and lines[last] ~= nil do last = last - 1 end
+	if first > last then return end
+	local fresh = {}
+	for line = first, last do
+		if lines[line] == nil then fresh[line], lines[line] = true, false end
+	end
+	buffer.search_flags = results.flags
+	local target_end = buffer.line_end_position[last]
+	buffer:set_target_range(buffer:position_from_line(first), target_end)
+	while buffer:search_in_target(results.text) ~= -1 do
+		local s, e = buffer.target_start, buffer.target_end
+		local line = buffer:line_from_position(s)
+		if fresh[line] then
+			local matches, line_start = lines[line] or {}, buffer:position_from_line(line)
+			matches[#matches + 1], matches[#matches + 2] = s - line_start, e - line_start
+			lines[line] = matches
+		end
+		if s == e then e = e + 1 end -- prevent loops for zero-length results
+		if e > target_end then break end
+		buffer:set_target_range(e, target_end)
+	end
+end
+
+--- Saves the current buffer's search state, which is clobbered by searching.
+local function save_state()
+	return {flags = buffer.search_flags, s = buffer.target_start, e = buffer.target_end}
+end
+
+--- Restores the current buffer's search state saved by `save_state()`.
+-- Regular expression searches also need to re-search the target in order to restore captures
+-- (`buffer.tag`) for any subsequent replacements.
+local function restore_state(state, results)
+	buffer.search_flags = state.flags
+	buffer:set_target_range(state.s, state.e)
+	if results and results.flags & buffer.FIND_REGEXP > 0 then
+		buffer:search_in_target(results.text)
+		buffer:set_target_range(state.s, state.e)
+	end
+end
+
+--- Highlights lines *first* through *last* with the given indicator and search results,
+-- searching those lines first if necessary.
+local function fill(results, indic, min_length, first, last)
+	search(results, first, last)
+	buffer.indicator_current = indic
+	for line = first, last do
+		local matches = results.lines[line]
+		if matches then
+			local line_start = buffer:position_from_line(line)
+			for i = 1, #matches, 2 do
+				local s, e = matches[i], matches[i + 1]
+				if e - s >= min_length then buffer:indicator_fill_range(line_start + s, e - s) end
+			end
+		end
+	end
+end
+
+--- Map of indicator numbers to their current highlighting jobs.
+local jobs = {}
+
+--- Clears the given indicator from the current buffer and cancels any highlighting in progress
+-- for it.
+-- @param indic The indicator number to clear.
+function M.clear(indic)
+	jobs[indic] = nil
+	buffer.indicator_current = indic
+	buffer:indicator_clear_range(1, buffer.length)
+end
+
+--- Highlights with the given indicator all occurrences of the given text in the current buffer.
+-- The lines visible in the current view are highlighted immediately, and the rest of the buffer
+-- is highlighted a slice at a time during idle time. Highlighting stops if it is cleared, if
+-- another highlight for the same indicator starts, if the current buffer changes, or if that
+-- buffer is modified.
+-- This does not clear any existing highlights.
+-- @param indic The indicator number to highlight with.
+-- @param text The text to search for.
+-- @param flags The search flags to use.
+-- @param[opt=1] min_length The minimum length of matches to highlight.
+function M.highlight(indic, text, flags, min_length)
+	local results, state = get_results(text, flags), save_state()
+	min_length = min_length or 1
+	local first = view:doc_line_from_visible(view.first_visible_line)
+	local last = math.min(view:doc_line_from_visible(view.first_visible_line + view.lines_on_screen),
+		buffer.line_count)
+	fill(results, indic, min_length, first, last)
+	-- Highlight the rest of the buffer, continuing downwards from the visible lines, then wrapping.
+	local slices = {}
+	for line = last + 1, buffer.line_count, SLICE_LINES do slices[#slices + 1] = line end
+	for line = 1, first - 1, SLICE_LINES do slices[#slices + 1] = line end
+	local job, i = {}, 1
+	jobs[indic] = job
+	local slice_buffer, edits = buffer, get_edits()
+	local function step()
+		if jobs[indic] ~= job or buffer ~= slice_buffer or get_edits() ~= edits or not slices[i] then
+			return false
+		end
+		local state = save_state()
+		local s = slices[i]
+		local e = math.min(s + SLICE_LINES - 1, s < first and first - 1 or buffer.line_count)
+		fill(get_results(text, flags), indic, min_length, s, math.min(e, buffer.line_count))
+		restore_state(state, results)
+		i = i + 1
+		return slices[i] ~= nil
+	end
+	if CURSES and WIN32 then -- no timeouts
+		while step() do end
+	elseif #slices > 0 then
+		timeout(0.01, step)
+	end
+	restore_state(state, results)
+end
+
+--- Returns the number of occurrences of the given text in the current buffer, along with the
+-- number of the occurrence that starts at position *pos*, or 1 if none do.
+-- @param text The text to search for.
+-- @param flags The search flags to use.
+-- @param pos The position of the current occurrence.
+function M.count(text, flags, pos)
+	local results, state = get_results(text, flags), save_state()
+	search(results, 1, buffer.line_count)
+	restore_state(state, results)
+	local count, current, current_line = 0, 1, buffer:line_from_position(pos)
+	for line = 1, buffer.line_count do
+		local matches = results.lines[line]
+		if matches then
+			if line == current_line then
+				local line_start = buffer:position_from_line(line)
+				for i = 1, #matches, 2 do
+					if line_start + matches[i] == pos then current = count + (i + 1) // 2 end
+				end
+			end
+			count = count + #matches // 2
+		end
+	end
+	return count, current
+end
+
+-- Updates cached search results as lines are modified, shifting the results after those lines
+-- and discarding the results on them.
+local INSERT, DELETE = _SCINTILLA.constants.MOD_INSERTTEXT, _SCINTILLA.constants.MOD_DELETETEXT
+events.connect(events.MODIFIED, function(position, mod, text, length, lines_added)
+	local cache = caches[buffer]
+	if not cache or mod & (INSERT | DELETE) == 0 then return end
+	local line = buffer:line_from_position(position)
+	local edits = get_edits() -- already counts this modification
+	for _, results in pairs(cache) do
+		if type(results) ~= 'table' then
+			-- Skip the number of cached results.
+		elseif results.multiline or results.edits ~= edits - 1 then
+			results.lines = {} -- the buffer was also changed without being watched
+		else
+			local lines, n = results.lines, results.line_count
+			if lines_added > 0 then
+				table.move(lines, line + 1, n, line + 1 + lines_added)
+				for i = line + 1, line + lines_added do lines[i] = nil end
+			elseif lines_added < 0 then
+				table.move(lines, line + 1 - lines_added, n, line + 1)
+				for i = n + lines_added + 1, n do lines[i] = nil end
+			end
+			lines[line] = nil
+		end
+		if type(results) == 'table' then
+			results.line_count, results.edits = buffer.line_count, edits
+		end
+	end
+end)
+
+return M
@@ -184,7 +184,13 @@ local default_menubar = {
 		}, {
 			title = _L['Macros'], --
 			{_L['Start/Stop Recording'], textadept.macros.record}, --
-			{_L['Play'], textadept.macros.play}, --
+			{_L['Play'], textadept.macros.play}, {
+				_L['Play Multiple Times...'], function()
+					local title = _L['Number of times to play (0 plays until the end):']
+					local n = tonumber(ui.dialogs.input{title = title} or nil)
+					if n then textadept.macros.play(nil, n) end
+				end
+			}, --
 			SEPARATOR, --
 			{_L['Save...'], textadept.macros.save}, --
 			{_L['Load...'], textadept.macros.load}
@@ -91,10 +91,11 @@ local line_state_indics = {M.INDIC_ERROR, M.INDIC_WARNING}
 -- @param silent Whether or not to print silently.
 -- @param ... Output to print.
 local function print_output(silent, ...)
-	local buffer = get_output_buffer()
-	local last_line = buffer and buffer.line_count or 1
-	buffer = ui[silent and 'output_silent' or 'output'](...)
-	for i = last_line, buffer.line_count do
+	local buffer = ui[silent and 'output_silent' or 'output'](...)
+	-- Count printed lines from the end, since printing may have trimmed the oldest lines.
+	local lines = 0
+	for _, output in ipairs{...} do lines = lines + select(2, tostring(output):gsub('\n', '')) end
+	for i = math.max(buffer.line_count - lines, 1), buffer.line_count do
 		local line_state = buffer.line_state[i]
 		if line_state > 0 then
 			buffer:marker_add(i, line_state_marks[line_state])
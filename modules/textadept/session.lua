@@ -4,6 +4,12 @@
 -- @module textadept.session
 local M = {}
 
+--- Defer reading session files until their buffers are first shown.
+-- Until then those buffers only know their filenames, selections, top lines, and bookmarks,
+-- which makes loading large sessions fast.
+-- The default value is `true`.
+M.defer_loading = true
+
 --- Save the session when quitting.
 -- The default value is `true` unless the user passed the command line switch `-n` or `--nosession`
 -- to Textadept.
@@ -32,6 +38,23 @@ for _, v in ipairs(session_events) do events[v:upper()] = v end
 
 local session_file = _USERHOME .. (not CURSES and '/session' or '/session_term')
 
+--- Restores the current buffer's selection, top line, and bookmarks from session buffer data
+-- *buf*.
+local function restore_buffer(buf)
+	buffer:set_sel(buf.anchor, buf.current_pos)
+	view.first_visible_line = buf.top_line
+	for _, line in ipairs(buf.bookmarks) do
+		buffer:marker_add(line, textadept.bookmarks.MARK_BOOKMARK)
+	end
+end
+
+-- Restores the state of a buffer whose session file was just loaded on demand.
+events.connect(events.FILE_OPENED, function()
+	if not buffer._session then return end
+	restore_buffer(buffer._session)
+	buffer._session, buffer._folds = nil, nil -- do not restore the unloaded buffer's state
+end)
+
 --- Loads session file *filename* or the user-selected session, returning `true` if a session
 -- file was opened and read.
 -- Textadept restores split views, opened buffers, cursor information, recent files, and bookmarks.
@@ -56,13 +79,14 @@ function M.load(filename)
 
 	-- Unserialize buffers.
 	for _, buf in ipairs(session.buffers) do
-		if lfs.attributes(buf.filename) then
+		if lfs.attributes(buf.filename) and M.defer_loading then
+			buffer.new()
+			buffer.filename, buffer._deferred, buffer._session = buf.filename, true, buf
+			events.emit(events.SAVE_POINT_REACHED, buffer) -- update tab label
+			io._close_initial_buffer() -- not opened, so events.FILE_OPENED is not emitted
+		elseif lfs.attributes(buf.filename) then
 			io.open_file(buf.filename)
-			buffer:set_sel(buf.anchor, buf.current_pos)
-			view.first_visible_line = buf.top_line
-			for _, line in ipairs(buf.bookmarks) do
-				buffer:marker_add(line, textadept.bookmarks.MARK_BOOKMARK)
-			end
+			restore_buffer(buf)
 		elseif buf.filename:find('^%[.+%]$') then
 			buffer.new()._type = buf.filename
 			buffer:set_save_point()
@@ -150,6 +174,10 @@ function M.save(filename)
 	session.buffers = {}
 	for _, buffer in ipairs(_BUFFERS) do
 		if not buffer.filename and not buffer._type then goto continue end
+		if buffer._session then -- never loaded, so keep its previous state
+			session.buffers[#session.buffers + 1] = buffer._session
+			goto continue
+		end
 		local current = buffer == view.buffer
 		session.buffers[#session.buffers + 1] = {
 			filename = buffer.filename or buffer._type,
@@ -7,20 +7,49 @@
 #include "lauxlib.h"
 
 // Library includes.
+#include <ctype.h> // for tolower
 #include <errno.h>
 #include <limits.h> // for MB_LEN_MAX
 #include <locale.h>
 #include <iconv.h>
 #include <math.h> // for fmax
+#include <stdint.h> // for uint64_t
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h> // for stat, mkdir
+#include <time.h> // for clock_gettime
+#include <wchar.h> // for WCHAR_MAX
+#include <wctype.h> // for towlower
 #if __linux__
 #include <unistd.h> // for readlink
 #elif _WIN32
 #include <windows.h> // for GetModuleFileName
+#include <direct.h> // for _mkdir
 #elif __APPLE__
 #include <mach-o/dyld.h> // for _NSGetExecutablePath
 #endif
+#if !_WIN32
+#include <dirent.h> // for opendir
+#include <fcntl.h> // for open
+#include <pthread.h>
+#include <sys/mman.h> // for mmap
+#include <unistd.h> // for fsync, getpid
+#else
+#include <io.h> // for _commit, _findfirst
+#include <fcntl.h> // for _O_EXCL
+#include <process.h> // for _getpid
+#define getpid _getpid
+#endif
+#if __linux__ || __APPLE__
+#include <sys/xattr.h>
+#endif
+#if __linux__
+#include <sys/inotify.h>
+#elif __APPLE__ || __FreeBSD__ || __NetBSD__ || __OpenBSD__ || __DragonFly__
+#include <fcntl.h> // for open
+#include <sys/event.h> // for kqueue
+#define HAVE_KQUEUE 1
+#endif
 
 // Variables declared in textadept.h.
 char *textadept_home;
@@ -35,7 +64,28 @@ static SciObject *dummy_view; // for working with documents not shown in an exis
 
 // Lua objects.
 static const char *BUFFERS = "ta_buffers", *VIEWS = "ta_views", *ARG = "ta_arg"; // registry tables
-static bool initing, closing;
+static const char *PROFILE = "ta_profile", *TRACE = "ta_trace"; // registry tables
+static const char *STDIN = "ta_stdin"; // registry function listening for stdin input
+static const char *WATCH = "ta_watch"; // registry function listening for watched file changes
+static const char *CHANGES = "ta_changes"; // registry table of file changes not yet reported
+static bool initing, closing, profiling; // profiling is enabled by '-P' or '--profile'
+static bool batch; // enabled by '-B' or '--batch', and by '-b' or '--bench'
+static int quit_status; // exit status requested by `quit()`, used once quitting goes ahead
+#define MAX_TRACE 100000 // maximum number of calls to record for a profiling timeline
+#define FILTER_THREAD_ROWS 50000 // minimum number of list dialog rows to filter per thread
+#define MAX_FILTER_THREADS 8
+#define MAX_SEARCH_THREADS 8 // maximum number of threads for reading files to search in
+#define POOL_CLASS_SIZE 16 // granularity of pooled Lua allocation sizes
+#define POOL_MAX_SIZE 256 // maximum size of a pooled Lua allocation; larger ones use malloc
+#define POOL_ARENA_SIZE (64 * 1024) // size of each arena that pooled allocations are carved from
+#define GC_IDLE_DELAY 0.1 // seconds after an event to perform a Lua garbage collection step
+#define WATCH_INTERVAL 0.5 // seconds between checks for the end of a burst of file changes
+#define WATCH_MAX_DELAY 2.0 // maximum seconds to wait for a burst of file changes to end
+#define WATCH_BUFFER_SIZE 16384 // size of each buffer that file change notifications are read into
+#define CONVERT_BUFFER_SIZE 65536 // size of the buffer that text is converted into while written
+#define FNV_OFFSET 14695981039346656037ULL // 64-bit FNV-1a hash parameters
+#define FNV_PRIME 1099511628211ULL
+#define CACHE_MAX 1000 // maximum number of files in the bytecode cache
 static int tabs = 1; // int for more options than true/false
 enum { SVOID, SINT, SLEN, SINDEX, SCOLOR, SBOOL, SKEYMOD, SSTRING, SSTRINGRET };
 LUALIB_API int luaopen_lpeg(lua_State *), luaopen_lfs(lua_State *), luaopen_regex(lua_State *);
@@ -45,12 +95,169 @@ static void add_doc(sptr_t doc);
 static SciObject *new_view(sptr_t);
 static bool init_lua(int, char **);
 
+// Pool of small Lua allocations.
+// Blocks are carved from large arenas in multiples of `POOL_CLASS_SIZE` bytes, and freed
+// blocks are kept in per-size free lists for reuse. Arenas are only freed along with the pool.
+static struct {
+	char *arenas, *next, *end; // arena list, and the unused space in the current arena
+	void *free[POOL_MAX_SIZE / POOL_CLASS_SIZE]; // free lists per size class
+	size_t reserved, free_bytes; // number of bytes in arenas and in free lists
+	size_t allocated; // number of bytes allocated since the last garbage collection step
+} pool;
+static bool gc_scheduled;
+
+// Returns the size class of a Lua allocation of the given size, or -1 if it is not pooled.
+static int size_class(size_t size) {
+	return size > 0 && size <= POOL_MAX_SIZE ? (int)((size - 1) / POOL_CLASS_SIZE) : -1;
+}
+
+// Returns a pooled block for the given size class, or NULL if there is no memory left.
+static void *pool_alloc(int class) {
+	size_t size = (class + 1) * POOL_CLASS_SIZE;
+	void *block = pool.free[class];
+	if (block) return (pool.free[class] = *(void **)block, pool.free_bytes -= size, block);
+	if ((size_t)(pool.end - pool.next) < size) {
+		char *arena = malloc(POOL_ARENA_SIZE);
+		if (!arena) return NULL;
+		*(char **)arena = pool.arenas, pool.arenas = arena, pool.reserved += POOL_ARENA_SIZE;
+		pool.next = arena + POOL_CLASS_SIZE, pool.end = arena + POOL_ARENA_SIZE; // keep alignment
+	}
+	return (block = pool.next, pool.next += size, block);
+}
+
+// Returns the given pooled block of the given size class to its free list.
+static void pool_free(void *block, int class) {
+	*(void **)block = pool.free[class], pool.free[class] = block;
+	pool.free_bytes += (class + 1) * POOL_CLASS_SIZE;
+}
+
+// Frees the pool's arenas.
+// This must only be called after the Lua state has been closed.
+static void free_pool() {
+	while (pool.arenas) {
+		char *arena = pool.arenas;
+		pool.arenas = *(char **)arena, free(arena);
+	}
+	memset(&pool, 0, sizeof(pool));
+}
+
+// Lua allocator that pools small allocations, since most of Lua's allocations are the strings
+// and tables of short-lived event arguments and property lookups.
+static void *lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+	if (!ptr) osize = 0; // osize is the type of object being allocated
+	int oclass = size_class(osize), nclass = size_class(nsize);
+	if (nsize > osize) pool.allocated += nsize - osize;
+	if (nsize == 0) {
+		if (ptr) oclass >= 0 ? pool_free(ptr, oclass) : free(ptr);
+		return NULL;
+	}
+	if (ptr && oclass == nclass) return oclass >= 0 ? ptr : realloc(ptr, nsize);
+	if (nclass < 0 && oclass < 0) return realloc(ptr, nsize);
+	void *block = nclass >= 0 ? pool_alloc(nclass) : malloc(nsize);
+	if (!block || !ptr) return block;
+	memcpy(block, ptr, osize < nsize ? osize : nsize);
+	return (oclass >= 0 ? pool_free(ptr, oclass) : free(ptr), block);
+}
+
+// Lua panic function for errors raised outside of a protected call.
+static int lua_panic(lua_State *L) {
+	const char *msg = lua_tostring(L, -1);
+	if (!msg) msg = "error object is not a string";
+	return (fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg), 0);
+}
+
+// Lua warning function that writes warnings to stderr like the standalone interpreter does.
+// Warnings are off until turned on by the "@on" control message and off again by "@off".
+static void lua_warning(void *ud, const char *msg, int tocont) {
+	static bool on = false, cont = false;
+	if (!cont && *msg == '@') {
+		if (strcmp(msg + 1, "on") == 0) on = true;
+		if (strcmp(msg + 1, "off") == 0) on = false;
+		return;
+	}
+	if (on) fprintf(stderr, "%s%s%s", !cont ? "Lua warning: " : "", msg, !tocont ? "\n" : "");
+	cont = tocont;
+}
+
+// Performs a Lua garbage collection step for what was allocated since the last step.
+// This is a timeout function scheduled by `schedule_gc()`.
+static bool step_gc(int *unused) {
+	if (lua) lua_gc(lua, LUA_GCSTEP, (int)(pool.allocated / 1024));
+	return (pool.allocated = 0, gc_scheduled = false, false);
+}
+
+// Schedules a Lua garbage collection step for after the current event, unless one is already
+// scheduled.
+// Since the step is a timeout function, platforms only call it between events, so more of the
+// collector's work happens while Textadept is idle rather than while it is handling events.
+static void schedule_gc() {
+	if (!gc_scheduled && lua && pool.allocated > 0)
+		gc_scheduled = add_timeout(GC_IDLE_DELAY, step_gc, NULL);
+}
+
 // Shows the given error in an error message dialog.
 static void show_error(const char *title, const char *message) {
 	DialogOptions opts = {title, message, "dialog-error", {"OK", NULL, NULL}};
 	lua_pop(lua, message_dialog(opts, lua));
 }
 
+// Returns the number of seconds elapsed since Textadept started, using a monotonic clock.
+static double clock_monotonic() {
+#if !_WIN32
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double t = now.tv_sec + now.tv_nsec / 1e9;
+#else
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now), QueryPerformanceFrequency(&frequency);
+	double t = (double)now.QuadPart / frequency.QuadPart;
+#endif
+	static double epoch = -1;
+	return (epoch < 0 ? (epoch = t) : 0, t - epoch);
+}
+
+// Records that the given profiling entry took from the given start time until now.
+// Each entry's call count, total time, and maximum time are accumulated in the PROFILE registry
+// table. If *trace* is true, the call is also added to the TRACE registry table (up to a limit)
+// for writing out a timeline later.
+static void profile(lua_State *L, const char *name, double start, bool trace) {
+	double elapsed = clock_monotonic() - start;
+	lua_getfield(L, LUA_REGISTRYINDEX, PROFILE);
+	if (lua_getfield(L, -1, name) != LUA_TTABLE) {
+		lua_pop(L, 1), lua_createtable(L, 0, 3), lua_pushvalue(L, -1), lua_setfield(L, -3, name);
+		lua_pushinteger(L, 0), lua_setfield(L, -2, "count");
+		lua_pushnumber(L, 0), lua_setfield(L, -2, "total");
+		lua_pushnumber(L, 0), lua_setfield(L, -2, "max");
+	}
+	lua_Integer count = (lua_getfield(L, -1, "count"), lua_tointeger(L, -1));
+	double total = (lua_getfield(L, -2, "total"), lua_tonumber(L, -1));
+	double max = (lua_getfield(L, -3, "max"), lua_tonumber(L, -1));
+	lua_pop(L, 3);
+	lua_pushinteger(L, count + 1), lua_setfield(L, -2, "count");
+	lua_pushnumber(L, total + elapsed), lua_setfield(L, -2, "total");
+	if (elapsed > max) lua_pushnumber(L, elapsed), lua_setfield(L, -2, "max");
+	if (lua_pop(L, 2), !trace) return; // entry, PROFILE
+	if (lua_getfield(L, LUA_REGISTRYINDEX, TRACE), lua_rawlen(L, -1) < MAX_TRACE) {
+		lua_createtable(L, 3, 0);
+		lua_pushstring(L, name), lua_rawseti(L, -2, 1);
+		lua_pushnumber(L, start), lua_rawseti(L, -2, 2);
+		lua_pushnumber(L, elapsed), lua_rawseti(L, -2, 3);
+		lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+	}
+	lua_pop(L, 1); // TRACE
+}
+
+// `_PROFILE.clock()` and `os._clock()` Lua functions.
+// Returns the number of seconds of wall-clock time since Textadept started.
+static int clock_lua(lua_State *L) { return (lua_pushnumber(L, clock_monotonic()), 1); }
+
+// `_PROFILE.record()` Lua function.
+static int record_lua(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+	double start = luaL_checknumber(L, 2);
+	return (profile(L, name, start, lua_isnone(L, 3) || lua_toboolean(L, 3)), 0);
+}
+
 bool emit(const char *name, ...) {
 	bool ret = false;
 	if (lua_getglobal(lua, "events") != LUA_TTABLE) return (lua_pop(lua, 1), ret);
@@ -76,7 +283,8 @@ bool emit(const char *name, ...) {
 		return (show_error("Error", lua_tostring(lua, -1)), lua_pop(lua, 2), ret); // error, events
 	else
 		ret = lua_toboolean(lua, -1);
-	return (lua_pop(lua, 2), ret); // result, events
+	if (strcmp(name, "quit") == 0) exit_status = !ret ? quit_status : exit_status, quit_status = 0;
+	return (lua_pop(lua, 2), schedule_gc(), ret); // result, events
 }
 
 void find_clicked(FindButton *button) {
@@ -264,7 +472,9 @@ static int call_scintilla(
 	}
 
 	// Send the message to Scintilla and return the appropriate values.
+	double start = profiling ? clock_monotonic() : 0;
 	sptr_t result = SS(view, msg, wparam, lparam);
+	if (profiling) profile(L, "scintilla", start, false); // too frequent to trace
 	if (string_return) lua_pushlstring(L, text, len), nresults++, free(text);
 	if (rtype == SINDEX && result >= 0) result++;
 	if (rtype > SVOID && rtype < SBOOL)
@@ -287,10 +497,25 @@ static int call_scintilla_lua(lua_State *L) {
 		view = view_for_doc(L, 1);
 	else if (is_type(L, 1, "ta_view"))
 		view = lua_toview(L, 1);
+	// Upvalues are of the form msg, rtype, wtype, ltype.
+	return call_scintilla(L, view, lua_tointeger(L, lua_upvalueindex(1)),
+		lua_tointeger(L, lua_upvalueindex(3)), lua_tointeger(L, lua_upvalueindex(4)),
+		lua_tointeger(L, lua_upvalueindex(2)), lua_istable(L, 1) ? 2 : 1);
+}
+
+// Pushes onto the Lua stack a callable closure for the Scintilla function whose name is at
+// stack index 2 and whose interface table is at the top of the stack.
+// Closures are created once and cached in the registry, and their interface values are stored
+// as upvalues, so calling a Scintilla function does not allocate or read the interface table.
+static void push_scintilla_function(lua_State *L) {
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "ta_methods"), lua_pushvalue(L, 2),
+		lua_rawget(L, -2) == LUA_TFUNCTION)
+		return;
+	lua_pop(L, 1); // nil
 	// Interface table is of the form {msg, rtype, wtype, ltype}.
-	return call_scintilla(L, view, get_int_field(L, lua_upvalueindex(1), 1),
-		get_int_field(L, lua_upvalueindex(1), 3), get_int_field(L, lua_upvalueindex(1), 4),
-		get_int_field(L, lua_upvalueindex(1), 2), lua_istable(L, 1) ? 2 : 1);
+	for (int i = 1; i <= 4; i++) lua_pushinteger(L, get_int_field(L, -1 - i, i));
+	lua_pushcclosure(L, call_scintilla_lua, 4);
+	lua_pushvalue(L, 2), lua_pushvalue(L, -2), lua_rawset(L, -4); // ta_methods[k] = f
 }
 
 // Sets the metatable for the value at the given Lua stack index to be the given metatable.
@@ -347,7 +572,7 @@ static int buffer_index(lua_State *L) {
 	if (lua_getfield(L, LUA_REGISTRYINDEX, "ta_functions"), lua_pushvalue(L, 2),
 		lua_rawget(L, -2) == LUA_TTABLE)
 		// If the key is a Scintilla function, return a callable closure.
-		lua_pushcclosure(L, call_scintilla_lua, 1);
+		push_scintilla_function(L);
 	else if (lua_getfield(L, LUA_REGISTRYINDEX, "ta_properties"), lua_pushvalue(L, 2),
 		lua_rawget(L, -2) == LUA_TTABLE)
 		// If the key is a Scintilla property, determine if it is an indexible one or not. If so,
@@ -470,6 +695,17 @@ static int list_dialog_lua(lua_State *L) {
 		L, opts.search_column > 0 && opts.search_column <= num_columns, 1, "invalid 'search_column'");
 	luaL_argcheck(
 		L, opts.items && lua_rawlen(L, opts.items) > 0, 1, "non-empty 'items' table expected");
+	// If there are numeric items, copy the items with those numbers converted to strings so
+	// platforms can refer to items directly. The copy remains on the stack, and the caller's
+	// table is left unchanged.
+	int num_items = lua_rawlen(L, opts.items), i = 1;
+	while (i <= num_items && (lua_rawgeti(L, opts.items, i) != LUA_TNUMBER)) lua_pop(L, 1), i++;
+	if (i <= num_items) {
+		lua_pop(L, 1), lua_createtable(L, num_items, 0);
+		for (i = 1; i <= num_items; i++)
+			lua_rawgeti(L, opts.items, i), lua_tostring(L, -1), lua_rawseti(L, -2, i);
+		opts.items = lua_gettop(L);
+	}
 	if (!opts.buttons[1])
 		opts.buttons[1] = (lua_getglobal(L, "_L"), lua_getfield(L, -1, "Cancel"), lua_tostring(L, -1));
 	return list_dialog(opts, L);
@@ -529,6 +765,9 @@ static int popup_menu_lua(lua_State *L) {
 // `ui.update()` Lua function.
 static int update_ui_lua(lua_State *L) { return (update_ui(), 0); }
 
+// `ui._wait()` Lua function.
+static int wait_ui_lua(lua_State *L) { return (wait_ui(), 0); }
+
 // `ui.suspend()` Lua function.
 static int suspend_lua(lua_State *L) { return (suspend(), 0); }
 
@@ -607,14 +846,219 @@ static int move_buffer_lua(lua_State *L) {
 }
 
 // `_G.quit()` Lua function.
-static int quit_lua(lua_State *L) { return (quit(), 0); }
+// The exit status only takes effect if no `events.QUIT` handler cancels quitting. In batch
+// mode, Textadept quits after initializing without emitting that event, so only set it.
+static int quit_lua(lua_State *L) {
+	quit_status = luaL_optinteger(L, 1, 0);
+	if (!batch) quit();
+	else exit_status = quit_status;
+	return 0;
+}
+
+// Returns the FNV-1a hash of the given bytes, continuing from hash *h*.
+static uint64_t fnv1a(uint64_t h, const char *s, size_t len) {
+	for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * FNV_PRIME;
+	return h;
+}
+
+// Returns a newly allocated path to the bytecode cache file for the given Lua file.
+// The cache lives in *_USERHOME/cache/*. Since the first few core files are loaded before
+// *core/args.lua* sets `_USERHOME`, derive it the same way that file does until then.
+static char *cache_filename(lua_State *L, const char *filename) {
+	int top = lua_gettop(L);
+	const char *userhome = NULL;
+	if (lua_getglobal(L, "_USERHOME") == LUA_TSTRING)
+		userhome = lua_tostring(L, -1);
+	else if (lua_getfield(L, LUA_REGISTRYINDEX, ARG) == LUA_TTABLE)
+		for (int i = 1; !userhome && lua_rawgeti(L, top + 2, i) == LUA_TSTRING; lua_pop(L, 1), i++) {
+			const char *arg = lua_tostring(L, -1);
+			if ((strcmp(arg, "-u") == 0 || strcmp(arg, "--userhome") == 0) &&
+				lua_rawgeti(L, top + 2, i + 1) == LUA_TSTRING)
+				userhome = lua_tostring(L, -1); // still referenced by ARG after popping
+		}
+#if !_WIN32
+	const char *home = getenv("HOME");
+#else
+	const char *home = getenv("USERPROFILE");
+#endif
+	if (!userhome && home) userhome = lua_pushfstring(L, "%s/.textadept", home);
+	uint64_t hash = fnv1a(FNV_OFFSET, filename, strlen(filename));
+	char *cache = NULL;
+	if (userhome) {
+		cache = malloc(strlen(userhome) + strlen("/cache/") + 16 + strlen(".luac") + 1);
+		sprintf(cache, "%s/cache/%016llx.luac", userhome, (unsigned long long)hash);
+	}
+	return (lua_settop(L, top), cache);
+}
+
+// Writes the given chunk of dumped Lua bytecode to the given file.
+static int write_chunk(lua_State *L, const void *p, size_t len, void *f) {
+	return fwrite(p, 1, len, f) != len;
+}
+
+// Computes the hash and size of the given file's contents and returns `true` on success.
+static bool hash_file(const char *filename, uint64_t *h, lua_Integer *size) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) return false;
+	char buf[BUFSIZ];
+	*h = FNV_OFFSET, *size = 0;
+	for (size_t len; (len = fread(buf, 1, sizeof(buf), f)) > 0; *size += len)
+		*h = fnv1a(*h, buf, len);
+	bool ok = !ferror(f);
+	return (fclose(f), ok);
+}
+
+// Returns the number of bytecode cache files in the given directory, and stores in *oldest* a
+// newly allocated path to the least recently written one (if any).
+static int scan_cache(const char *dir, char **oldest) {
+	int n = 0;
+	time_t oldest_time = 0;
+	*oldest = NULL;
+#if !_WIN32
+	DIR *d = opendir(dir);
+	if (!d) return 0;
+	for (struct dirent *entry; (entry = readdir(d));) {
+		size_t len = strlen(entry->d_name);
+		if (len < 5 || strcmp(entry->d_name + len - 5, ".luac") != 0) continue;
+		char *path = malloc(strlen(dir) + 1 + len + 1);
+		struct stat st;
+		if (sprintf(path, "%s/%s", dir, entry->d_name), stat(path, &st) != 0) {
+			free(path);
+			continue;
+		}
+		if (n++, !*oldest || st.st_mtime < oldest_time)
+			free(*oldest), *oldest = path, oldest_time = st.st_mtime;
+		else
+			free(path);
+	}
+	closedir(d);
+#else
+	char *pattern = malloc(strlen(dir) + strlen("/*.luac") + 1);
+	sprintf(pattern, "%s/*.luac", dir);
+	struct _finddata_t entry;
+	intptr_t handle = _findfirst(pattern, &entry);
+	if (free(pattern), handle == -1) return 0;
+	do {
+		if (n++, *oldest && entry.time_write >= oldest_time) continue;
+		free(*oldest), *oldest = malloc(strlen(dir) + 1 + strlen(entry.name) + 1);
+		sprintf(*oldest, "%s/%s", dir, entry.name), oldest_time = entry.time_write;
+	} while (_findnext(handle, &entry) == 0);
+	_findclose(handle);
+#endif
+	return n;
+}
+
+// Removes the least recently written bytecode cache files in the given directory until no more
+// than `CACHE_MAX` remain.
+static void prune_cache(const char *dir) {
+	char *oldest;
+	while (scan_cache(dir, &oldest) > CACHE_MAX) remove(oldest), free(oldest);
+	free(oldest);
+}
+
+// Loads the given Lua file like `luaL_loadfilex()`, but from its precompiled bytecode in the
+// user's cache if that is still up-to-date. Otherwise, loads the file's source and caches its
+// bytecode for next time.
+// Cache files start with a line identifying the source file's path, size, and content hash.
+// If the cached bytecode is stale, corrupt, or from a different version of Lua, the source is
+// used instead. A mode that does not allow both text and binary chunks bypasses the cache.
+// The first time a file is cached, the cache is pruned to `CACHE_MAX` files.
+static int load_file(lua_State *L, const char *filename, const char *mode) {
+	static bool pruned = false;
+	uint64_t hash;
+	lua_Integer size;
+	if (!filename || (mode && (!strchr(mode, 't') || !strchr(mode, 'b'))) ||
+		!hash_file(filename, &hash, &size))
+		return luaL_loadfilex(L, filename, mode);
+	int top = lua_gettop(L);
+	char *cache = cache_filename(L, filename);
+	if (!cache) return luaL_loadfilex(L, filename, mode);
+	const char *header = lua_pushfstring(L, "%s %I %I\n", filename, size, (lua_Integer)hash);
+	size_t header_len = lua_rawlen(L, -1);
+	const char *chunkname = lua_pushfstring(L, "@%s", filename);
+	FILE *f = fopen(cache, "rb");
+	if (f) {
+		fseek(f, 0, SEEK_END);
+		long len = ftell(f);
+		char *bytecode = len > 0 ? malloc(len) : NULL;
+		bool ok = bytecode && (fseek(f, 0, SEEK_SET), fread(bytecode, 1, len, f) == (size_t)len) &&
+			(size_t)len > header_len && memcmp(bytecode, header, header_len) == 0 &&
+			luaL_loadbufferx(L, bytecode + header_len, len - header_len, chunkname, "b") == LUA_OK;
+		if (free(bytecode), fclose(f), ok)
+			return (lua_replace(L, top + 1), lua_settop(L, top + 1), free(cache), LUA_OK);
+		lua_settop(L, top + 2); // header, chunkname
+	}
+	int status = luaL_loadfilex(L, filename, mode);
+	if (status == LUA_OK && (f = fopen(filename, "rb"))) {
+		bool text = getc(f) != LUA_SIGNATURE[0]; // do not re-cache precompiled files
+		if (fclose(f), text) {
+			char *dir = malloc(strlen(cache) + 1);
+			strcpy(dir, cache), *strrchr(dir, '/') = '\0';
+#if !_WIN32
+			mkdir(dir, 0755);
+#else
+			_mkdir(dir);
+#endif
+			if (!pruned) prune_cache(dir), pruned = true;
+			free(dir);
+			// Write to a temporary file first so a concurrent instance never reads a partial cache,
+			// and name it after this process so concurrent instances never write to the same one.
+			char *tmp = malloc(strlen(cache) + 1 + 20 + strlen(".tmp") + 1);
+			sprintf(tmp, "%s.%d.tmp", cache, (int)getpid());
+			if ((f = fopen(tmp, "wb"))) {
+				bool ok = fwrite(header, 1, header_len, f) == header_len &&
+					lua_dump(L, write_chunk, f, 0) == 0;
+				if (fclose(f) == 0 && ok) {
+#if _WIN32
+					remove(cache); // rename() does not overwrite on Windows
+#endif
+					if (rename(tmp, cache) == 0) tmp[0] = '\0';
+				}
+				if (tmp[0]) remove(tmp);
+			}
+			free(tmp);
+		}
+	}
+	return (lua_replace(L, top + 1), lua_settop(L, top + 1), free(cache), status);
+}
+
+// `_G.loadfile()` Lua function, which uses the bytecode cache.
+static int loadfile_lua(lua_State *L) {
+	const char *filename = luaL_optstring(L, 1, NULL), *mode = luaL_optstring(L, 2, NULL);
+	int env = !lua_isnone(L, 3) ? 3 : 0;
+	if (load_file(L, filename, mode) != LUA_OK) return (lua_pushnil(L), lua_insert(L, -2), 2);
+	if (env && (lua_pushvalue(L, env), !lua_setupvalue(L, -2, 1))) lua_pop(L, 1); // set _ENV
+	return 1;
+}
+
+// `_G.dofile()` Lua function, which uses the bytecode cache.
+static int dofile_lua(lua_State *L) {
+	const char *filename = luaL_optstring(L, 1, NULL);
+	if (lua_settop(L, 1), load_file(L, filename, NULL) != LUA_OK) return lua_error(L);
+	return (lua_call(L, 0, LUA_MULTRET), lua_gettop(L) - 1);
+}
+
+// Lua `package.searchers` function that finds Lua modules along `package.path` like Lua's own
+// searcher does, but loads them using the bytecode cache.
+static int searcher_lua(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+	lua_getglobal(L, "package"), lua_getfield(L, -1, "searchpath");
+	if (lua_pushvalue(L, 1), lua_getfield(L, -3, "path") != LUA_TSTRING)
+		luaL_error(L, "'package.path' must be a string");
+	if (lua_call(L, 2, 2), lua_isnil(L, -2)) return 1; // error message
+	const char *filename = lua_tostring(L, -2);
+	if (load_file(L, filename, NULL) != LUA_OK)
+		luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename,
+			lua_tostring(L, -1));
+	return (lua_pushstring(L, filename), 2);
+}
 
 // Runs the given Lua file, which is relative to `textadept_home`, and returns `true` on success.
 // If there are errors, shows an error dialog and returns `false`.
 static bool run_file(const char *filename) {
 	char *file = malloc(strlen(textadept_home) + 1 + strlen(filename) + 1);
 	sprintf(file, "%s/%s", textadept_home, filename);
-	bool ok = luaL_dofile(lua, file) == LUA_OK;
+	bool ok = load_file(lua, file, NULL) == LUA_OK && lua_pcall(lua, 0, 0, 0) == LUA_OK;
 	if (!ok) show_error("Initialization Error", lua_tostring(lua, -1)), lua_settop(lua, 0);
 	return (free(file), ok);
 }
@@ -640,7 +1084,9 @@ static bool call_timeout_function(int *refs) {
 	int nargs = 0;
 	lua_rawgeti(lua, LUA_REGISTRYINDEX, refs[0]); // function
 	while (refs[++nargs]) lua_rawgeti(lua, LUA_REGISTRYINDEX, refs[nargs]);
+	double start = profiling ? clock_monotonic() : 0;
 	bool ok = lua_pcall(lua, nargs - 1, 1, 0) == LUA_OK, repeat;
+	if (profiling) profile(lua, "timeout", start, true);
 	if (!(repeat = ok && lua_toboolean(lua, -1))) {
 		while (--nargs >= 0) luaL_unref(lua, LUA_REGISTRYINDEX, refs[nargs]);
 		free(refs);
@@ -662,6 +1108,24 @@ static int add_timeout_lua(lua_State *L) {
 	return 0;
 }
 
+// Converts the given input using the given conversion descriptor and adds the result to the
+// given buffer, growing it in increments of the given size as needed.
+// If *inbuf* is NULL, flushes any output remaining in the conversion state.
+// Returns the number of input bytes left over at the end of an incomplete multibyte sequence,
+// or -1 if the conversion failed.
+static long convert(iconv_t cd, char *inbuf, size_t inbytesleft, size_t bufsiz, luaL_Buffer *b) {
+	while (true) {
+		char *outbuf = luaL_prepbuffsize(b, bufsiz), *p = outbuf;
+		size_t outbytesleft = bufsiz;
+		size_t result = iconv(
+			cd, inbuf ? &inbuf : NULL, inbuf ? &inbytesleft : NULL, &p, &outbytesleft);
+		luaL_addsize(b, p - outbuf);
+		if (result != (size_t)-1) return 0;
+		if (errno == EINVAL && inbuf) return inbytesleft; // incomplete multibyte sequence
+		if (errno != E2BIG || p == outbuf) return -1;
+	}
+}
+
 // `string.iconv()` Lua function.
 static int iconv_lua(lua_State *L) {
 	size_t inbytesleft = 0;
@@ -670,30 +1134,147 @@ static int iconv_lua(lua_State *L) {
 	iconv_t cd = iconv_open(to, from);
 	if (cd == (iconv_t)-1) luaL_error(L, "invalid encoding(s)");
 	// Ensure the minimum buffer size can hold a potential output BOM and one multibyte character.
+	// Converting into a single growable buffer avoids intermediate strings and their concatenation.
+	// Peak memory use is still a few times the size of the result, since the buffer grows by
+	// doubling and then copies into the result string.
 	size_t bufsiz = 4 + (inbytesleft > MB_LEN_MAX ? inbytesleft : MB_LEN_MAX);
-	char *outbuf = malloc(bufsiz + 1), *p = outbuf;
-	size_t outbytesleft = bufsiz;
-	int n = 1; // concat this many converted strings
-	while (iconv(cd, &inbuf, &inbytesleft, &p, &outbytesleft) == (size_t)-1)
-		if (errno == E2BIG && p - outbuf > 0) {
-			// Buffer was too small to store converted string. Push the partially converted string
-			// for later concatenation.
-			lua_checkstack(L, 2), lua_pushlstring(L, outbuf, p - outbuf), n++;
-			p = outbuf, outbytesleft = bufsiz;
-		} else
-			free(outbuf), iconv_close(cd), luaL_error(L, "conversion failed");
-	lua_pushlstring(L, outbuf, p - outbuf);
-	return (lua_concat(L, n), free(outbuf), iconv_close(cd), 1);
-}
-
-void process_output(Process *proc, const char *buf, size_t len, bool is_stdout) {
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	if (convert(cd, inbuf, inbytesleft, bufsiz, &b) != 0 || convert(cd, NULL, 0, MB_LEN_MAX, &b) < 0)
+		iconv_close(cd), luaL_error(L, "conversion failed");
+	return (luaL_pushresult(&b), iconv_close(cd), 1);
+}
+
+// `converter:convert()` Lua method.
+static int converter_convert(lua_State *L) {
+	iconv_t *cd = luaL_checkudata(L, 1, "ta_iconv");
+	luaL_argcheck(L, *cd != (iconv_t)-1, 1, "converter is closed");
+	lua_settop(L, 2);
+	bool flush = lua_isnil(L, 2);
+	if (!flush) luaL_checkstring(L, 2);
+	// Prepend any incomplete multibyte sequence left over from the previous chunk.
+	lua_getiuservalue(L, 1, 1);
+	if (!flush) lua_insert(L, 2), lua_concat(L, 2);
+	size_t inbytesleft = 0;
+	char *inbuf = (char *)lua_tolstring(L, -1, &inbytesleft);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	long left = flush ? (inbytesleft ? -1 : convert(*cd, NULL, 0, MB_LEN_MAX, &b)) :
+											convert(*cd, inbuf, inbytesleft, BUFSIZ + MB_LEN_MAX, &b);
+	if (left < 0) luaL_error(L, "conversion failed");
+	luaL_pushresult(&b);
+	lua_pushlstring(L, inbuf + inbytesleft - left, left), lua_setiuservalue(L, 1, 1);
+	return 1;
+}
+
+// `converter:close()` Lua method and `converter:__gc()` Lua metamethod.
+static int converter_close(lua_State *L) {
+	iconv_t *cd = luaL_checkudata(L, 1, "ta_iconv");
+	if (*cd != (iconv_t)-1) iconv_close(*cd), *cd = (iconv_t)-1;
+	return 0;
+}
+
+// `string.iconv_open()` Lua function.
+static int iconv_open_lua(lua_State *L) {
+	const char *to = luaL_checkstring(L, 1), *from = luaL_checkstring(L, 2);
+	iconv_t *cd = lua_newuserdatauv(L, sizeof(iconv_t), 1);
+	if ((*cd = iconv_open(to, from)) == (iconv_t)-1) luaL_error(L, "invalid encoding(s)");
+	lua_pushliteral(L, ""), lua_setiuservalue(L, -2, 1); // incomplete multibyte sequence
+	if (luaL_newmetatable(L, "ta_iconv")) {
+		lua_pushcfunction(L, converter_convert), lua_setfield(L, -2, "convert");
+		lua_pushcfunction(L, converter_close), lua_setfield(L, -2, "close");
+		lua_pushcfunction(L, converter_close), lua_setfield(L, -2, "__gc");
+		lua_pushvalue(L, -1), lua_setfield(L, -2, "__index");
+	}
+	return (lua_setmetatable(L, -2), 1);
+}
+
+// `string.is_utf8()` Lua function.
+static int is_utf8_lua(lua_State *L) {
+	size_t len;
+	const unsigned char *s = (const unsigned char *)luaL_checklstring(L, 1, &len), *end = s + len;
+	while (s < end) {
+		// Skip ASCII text a word at a time.
+		uint64_t word;
+		if (end - s >= 8 && (memcpy(&word, s, 8), !(word & 0x8080808080808080ULL))) {
+			s += 8;
+			continue;
+		} else if (*s < 0x80) {
+			s++;
+			continue;
+		}
+		// Decode a multibyte sequence and reject overlong encodings, surrogates, and code points
+		// beyond U+10FFFF.
+		int n = (*s & 0xE0) == 0xC0 ? 1 : (*s & 0xF0) == 0xE0 ? 2 : (*s & 0xF8) == 0xF0 ? 3 : 0;
+		if (!n || end - s <= n) return (lua_pushboolean(L, false), 1);
+		uint32_t code = *s & (0x3F >> n);
+		for (int i = 1; i <= n; i++) {
+			if ((s[i] & 0xC0) != 0x80) return (lua_pushboolean(L, false), 1);
+			code = code << 6 | (s[i] & 0x3F);
+		}
+		if (code < (n == 1 ? 0x80 : n == 2 ? 0x800 : 0x10000) || (code >= 0xD800 && code <= 0xDFFF) ||
+			code > 0x10FFFF)
+			return (lua_pushboolean(L, false), 1);
+		s += n + 1;
+	}
+	return (lua_pushboolean(L, true), 1);
+}
+
+// Pending stdout and stderr of a spawned process. It is stored in the process' userdata just
+// after the platform's Process struct.
+struct ProcessOutput {
+	char *buf[2];
+	size_t len[2];
+};
+
+// Returns the offset of pending output in a process' userdata, suitably aligned.
+static size_t process_output_offset() { return (process_size() + 15) & ~(size_t)15; }
+
+// Returns the pending output of the given process.
+static struct ProcessOutput *process_output_of(Process *proc) {
+	return (struct ProcessOutput *)((char *)proc + process_output_offset());
+}
+
+// Calls the given process' stdout or stderr function with the first *len* bytes of its pending
+// output and keeps the rest for later.
+static void deliver_process_output(Process *proc, int i, size_t len) {
+	struct ProcessOutput *output = process_output_of(proc);
 	lua_rawgetp(lua, LUA_REGISTRYINDEX, proc);
-	lua_getiuservalue(lua, -1, is_stdout ? 1 : 2), lua_replace(lua, -2);
-	if (lua_pushlstring(lua, buf, len), lua_pcall(lua, 1, 0, 0) != LUA_OK)
+	lua_getiuservalue(lua, -1, i + 1), lua_replace(lua, -2);
+	lua_pushlstring(lua, output->buf[i], len);
+	memmove(output->buf[i], output->buf[i] + len, output->len[i] -= len);
+	double start = profiling ? clock_monotonic() : 0;
+	if (lua_pcall(lua, 1, 0, 0) != LUA_OK)
 		show_error("Process Output Error", lua_tostring(lua, -1)), lua_pop(lua, 1);
+	if (profiling) profile(lua, "process output", start, true);
+}
+
+bool process_output(Process *proc, const char *buf, size_t len, bool is_stdout) {
+	struct ProcessOutput *output = process_output_of(proc);
+	int i = is_stdout ? 0 : 1;
+	bool full = false;
+	if (!output->buf[i]) output->buf[i] = malloc(PROCESS_OUTPUT_SIZE);
+	while (len > 0) {
+		size_t n = PROCESS_OUTPUT_SIZE - output->len[i];
+		if (n > len) n = len;
+		memcpy(output->buf[i] + output->len[i], buf, n), output->len[i] += n, buf += n, len -= n;
+		if (output->len[i] < PROCESS_OUTPUT_SIZE) break;
+		// Deliver only complete lines from a full buffer, unless it contains a single long line.
+		size_t end = output->len[i];
+		while (end > 0 && output->buf[i][end - 1] != '\n') end--;
+		deliver_process_output(proc, i, end > 0 ? end : output->len[i]), full = true;
+	}
+	return !full;
+}
+
+void flush_process_output(Process *proc) {
+	struct ProcessOutput *output = process_output_of(proc);
+	for (int i = 0; i < 2; i++)
+		if (output->len[i] > 0) deliver_process_output(proc, i, output->len[i]);
 }
 
 void process_exited(Process *proc, int code) {
+	flush_process_output(proc);
 	lua_rawgetp(lua, LUA_REGISTRYINDEX, proc);
 	if (lua_getiuservalue(lua, -1, 3)) {
 		if ((lua_pushinteger(lua, code), lua_pcall(lua, 1, 0, 0)) != LUA_OK)
@@ -703,6 +1284,27 @@ void process_exited(Process *proc, int code) {
 	lua_pushnil(lua), lua_replace(lua, -2), lua_rawsetp(lua, LUA_REGISTRYINDEX, proc); // allow GC
 }
 
+void stdin_input(const char *s, size_t len) {
+	if (lua_getfield(lua, LUA_REGISTRYINDEX, STDIN) != LUA_TFUNCTION) return (void)lua_pop(lua, 1);
+	len > 0 ? lua_pushlstring(lua, s, len) : lua_pushnil(lua);
+	if (len == 0) lua_pushnil(lua), lua_setfield(lua, LUA_REGISTRYINDEX, STDIN); // stdin closed
+	double start = profiling ? clock_monotonic() : 0;
+	if (lua_pcall(lua, 1, 0, 0) != LUA_OK)
+		show_error("Stdin Error", lua_tostring(lua, -1)), lua_pop(lua, 1);
+	if (profiling) profile(lua, "stdin", start, true);
+}
+
+// `io._read_stdin()` Lua function.
+static int read_stdin_lua(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	if (lua_getfield(L, LUA_REGISTRYINDEX, STDIN) != LUA_TNIL)
+		return luaL_error(L, "stdin is already being read");
+	lua_pushvalue(L, 1), lua_setfield(L, LUA_REGISTRYINDEX, STDIN);
+	if (watch_stdin()) return (lua_pushboolean(L, true), 1);
+	lua_pushnil(L), lua_setfield(L, LUA_REGISTRYINDEX, STDIN);
+	return (lua_pushboolean(L, false), 1);
+}
+
 // `proc:status()` Lua method.
 static int proc_status(lua_State *L) {
 	Process *proc = luaL_checkudata(L, 1, "ta_spawn");
@@ -756,7 +1358,11 @@ static int proc_kill(lua_State *L) {
 }
 
 // `proc:__gc()` Lua metamethod.
-static int proc_gc(lua_State *L) { return (cleanup_process(luaL_checkudata(L, 1, "ta_spawn")), 0); }
+static int proc_gc(lua_State *L) {
+	Process *proc = luaL_checkudata(L, 1, "ta_spawn");
+	struct ProcessOutput *output = process_output_of(proc);
+	return (free(output->buf[0]), free(output->buf[1]), cleanup_process(proc), 0);
+}
 
 // `os.spawn()` Lua function.
 static int spawn_lua(lua_State *L) {
@@ -778,7 +1384,8 @@ static int spawn_lua(lua_State *L) {
 	}
 
 	// Create process object to be returned and link callback functions from optional function params.
-	Process *proc = lua_newuserdatauv(L, process_size(), 3);
+	Process *proc = lua_newuserdatauv(L, process_output_offset() + sizeof(struct ProcessOutput), 3);
+	memset(process_output_of(proc), 0, sizeof(struct ProcessOutput));
 	for (int i = narg; i <= top && i < narg + 3; i++)
 		luaL_argcheck(L, lua_isfunction(L, i) || lua_isnil(L, i), i, "function or nil expected"),
 			lua_pushvalue(L, i), lua_setiuservalue(L, -2, i - narg + 1);
@@ -804,17 +1411,881 @@ static int spawn_lua(lua_State *L) {
 	return ((lua_pushvalue(L, -1), lua_rawsetp(L, LUA_REGISTRYINDEX, proc)), 1); // prevent GC
 }
 
+// Returns the lowercase form (according to the current locale) of the UTF-8 character at the
+// start of the given string, and stores that character's length in bytes in *len*.
+// Invalid UTF-8 bytes are returned as-is, one at a time.
+static unsigned int lower_char(const char *s, int *len) {
+	const unsigned char *u = (const unsigned char *)s;
+	if (*u < 0x80) return (*len = 1, tolower(*u));
+	int n = *u >= 0xF0 && *u < 0xF8 ? 4 : *u >= 0xE0 ? 3 : *u >= 0xC0 ? 2 : 1;
+	unsigned int c = n == 1 ? *u : *u & (0x7F >> n);
+	for (int i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80) return (*len = 1, *u); // also stops at the terminating '\0'
+		c = (c << 6) | (u[i] & 0x3F);
+	}
+	if (*len = n, n == 1 || c > WCHAR_MAX) return c;
+	return towlower(c);
+}
+
+// Returns a pointer past the part of the given string that matches the first *len* bytes of
+// the given word, ignoring case, or NULL if there is no match.
+static const char *match_word(const char *s, const char *word, size_t len) {
+	for (const char *end = word + len; word < end;) {
+		int n, m;
+		if (!*s || lower_char(s, &n) != lower_char(word, &m)) return NULL;
+		s += n, word += m;
+	}
+	return s;
+}
+
+bool list_item_matches(const char *item, const char *key) {
+	for (const char *s = key, *e = s;; s = e) {
+		while (*e && *e != ' ') e++;
+		const char *p = item, *end;
+		for (int n; !(end = match_word(p, s, e - s)) && *p; p += n) lower_char(p, &n);
+		if (!end) return false;
+		if (item = end, !*e++) return true;
+	}
+}
+
+// A portion of a list filter's rows to filter on a worker thread.
+struct FilterJob {
+	const char **items, *key;
+	int *rows, num_rows, num_matches;
+	bool threaded;
+#if !_WIN32
+	pthread_t thread;
+#else
+	HANDLE thread;
+#endif
+};
+
+// Filters the given job's rows in place, keeping only those whose items match its key.
+static void filter_rows(struct FilterJob *job) {
+	job->num_matches = 0;
+	for (int i = 0; i < job->num_rows; i++)
+		if (list_item_matches(job->items[job->rows[i]], job->key))
+			job->rows[job->num_matches++] = job->rows[i];
+}
+
+// Entry point for a thread that filters list rows.
+#if !_WIN32
+static void *filter_rows_thread(void *job) { return (filter_rows(job), NULL); }
+#else
+static DWORD WINAPI filter_rows_thread(void *job) { return (filter_rows(job), 0); }
+#endif
+
+void init_list_filter(ListFilter *filter, const char **items, int num_rows) {
+	filter->items = items, filter->num_rows = filter->num_matches = num_rows;
+	filter->matches = malloc((num_rows > 0 ? num_rows : 1) * sizeof(int));
+	for (int i = 0; i < num_rows; i++) filter->matches[i] = i;
+	filter->key = strcpy(malloc(1), "");
+}
+
+void filter_list(ListFilter *filter, const char *key) {
+	// A key that only appends to the previous key can only match rows the previous key matched.
+	if (strncmp(key, filter->key, strlen(filter->key)) != 0) {
+		for (int i = 0; i < filter->num_rows; i++) filter->matches[i] = i;
+		filter->num_matches = filter->num_rows;
+	}
+	free(filter->key), filter->key = strcpy(malloc(strlen(key) + 1), key);
+	// Split rows between jobs, filtering the first one on this thread.
+	int n = filter->num_matches, num_jobs = n / FILTER_THREAD_ROWS;
+	if (num_jobs < 1) num_jobs = 1;
+	if (num_jobs > MAX_FILTER_THREADS) num_jobs = MAX_FILTER_THREADS;
+	struct FilterJob jobs[MAX_FILTER_THREADS];
+	for (int i = 0; i < num_jobs; i++) {
+		int start = (long long)n * i / num_jobs, end = (long long)n * (i + 1) / num_jobs;
+		struct FilterJob *job = &jobs[i];
+		job->items = filter->items, job->key = key, job->rows = filter->matches + start,
+		job->num_rows = end - start, job->threaded = false;
+#if !_WIN32
+		if (i > 0) job->threaded = pthread_create(&job->thread, NULL, filter_rows_thread, job) == 0;
+#else
+		if (i > 0)
+			job->threaded = (job->thread = CreateThread(NULL, 0, filter_rows_thread, job, 0, NULL));
+#endif
+		if (i > 0 && !job->threaded) filter_rows(job);
+	}
+	filter_rows(&jobs[0]), filter->num_matches = 0;
+	for (int i = 0; i < num_jobs; i++) {
+		struct FilterJob *job = &jobs[i];
+#if !_WIN32
+		if (job->threaded) pthread_join(job->thread, NULL);
+#else
+		if (job->threaded) WaitForSingleObject(job->thread, INFINITE), CloseHandle(job->thread);
+#endif
+		memmove(filter->matches + filter->num_matches, job->rows, job->num_matches * sizeof(int));
+		filter->num_matches += job->num_matches;
+	}
+}
+
+void free_list_filter(ListFilter *filter) { free(filter->matches), free(filter->key); }
+
+// `ui.dialogs._filter()` Lua function.
+// Filters the given list of items like a list dialog does as each of the given search keys is
+// typed in turn, and returns for each key a list of the (1-based) indices of matching items.
+static int filter_list_lua(lua_State *L) {
+	int num_rows = (luaL_checktype(L, 1, LUA_TTABLE), lua_rawlen(L, 1)), num_keys = lua_gettop(L) - 1;
+	for (int i = 1; i <= num_rows; lua_pop(L, 1), i++)
+		luaL_argcheck(L, lua_rawgeti(L, 1, i) == LUA_TSTRING, 1, "strings expected");
+	for (int i = 2; i <= num_keys + 1; i++) luaL_checkstring(L, i);
+	luaL_checkstack(L, num_keys, "too many keys");
+	const char **items = malloc((num_rows > 0 ? num_rows : 1) * sizeof(char *));
+	for (int i = 0; i < num_rows; lua_pop(L, 1), i++)
+		items[i] = (lua_rawgeti(L, 1, i + 1), lua_tostring(L, -1)); // owned by the table
+	ListFilter filter;
+	init_list_filter(&filter, items, num_rows);
+	for (int i = 2; i <= num_keys + 1; i++) {
+		filter_list(&filter, lua_tostring(L, i)), lua_createtable(L, filter.num_matches, 0);
+		for (int j = 0; j < filter.num_matches; j++)
+			lua_pushinteger(L, filter.matches[j] + 1), lua_rawseti(L, -2, j + 1);
+	}
+	return (free_list_filter(&filter), free(items), num_keys);
+}
+
+// A file to write on a worker thread, along with the result of writing it.
+struct FileWrite {
+	const char *filename, **chunks;
+	size_t *lens;
+	int num_chunks;
+	iconv_t cd; // converts chunks from UTF-8 as they are written, or (iconv_t)-1
+	uint64_t hash; // of the bytes written
+	char error[256];
+	bool threaded;
+#if !_WIN32
+	pthread_t thread;
+#else
+	HANDLE thread;
+#endif
+};
+
+#if __linux__ || __APPLE__
+#if __linux__
+#define LISTXATTR(path, list, size) listxattr(path, list, size)
+#define GETXATTR(path, name, value, size) getxattr(path, name, value, size)
+#define FSETXATTR(fd, name, value, size) fsetxattr(fd, name, value, size, 0)
+#else
+#define LISTXATTR(path, list, size) listxattr(path, list, size, 0)
+#define GETXATTR(path, name, value, size) getxattr(path, name, value, size, 0, 0)
+#define FSETXATTR(fd, name, value, size) fsetxattr(fd, name, value, size, 0, 0)
+#endif
+// Copies the extended attributes of the given file (which include its ACLs on Linux) to the
+// given file descriptor, and returns whether or not all of them were copied.
+static bool copy_xattrs(const char *filename, int fd) {
+	ssize_t len = LISTXATTR(filename, NULL, 0);
+	if (len <= 0) return len == 0 || errno == ENOTSUP;
+	char *names = malloc(len), *value = NULL;
+	bool ok = names && (len = LISTXATTR(filename, names, len)) >= 0;
+	for (char *name = names; ok && name < names + len; name += strlen(name) + 1) {
+		ssize_t size = GETXATTR(filename, name, NULL, 0);
+		char *resized = size >= 0 ? realloc(value, size + 1) : NULL;
+		ok = resized && (value = resized, size = GETXATTR(filename, name, value, size)) >= 0 &&
+			FSETXATTR(fd, name, value, size) == 0;
+	}
+	return (free(names), free(value), ok);
+}
+#endif
+
+// Creates a uniquely named temporary file next to the given file for writing that file's
+// contents to, stores the temporary file's name in *tmp*, and returns it opened for writing.
+// Returns NULL if the given file should be written in place instead: if it does not exist yet,
+// if the temporary file cannot be created (e.g. the directory is not writable), or if renaming
+// over the file would lose its hard links, owner, group, or extended attributes.
+static FILE *open_temporary_file(const char *filename, char **tmp) {
+	struct stat st;
+	if (stat(filename, &st) != 0) return NULL;
+#if !_WIN32
+	if (st.st_nlink > 1 || st.st_uid != geteuid()) return NULL;
+#endif
+	size_t len = strlen(filename) + sizeof(".textadept~XXXXXX");
+	if (!(*tmp = malloc(len))) return NULL;
+	snprintf(*tmp, len, "%s.textadept~XXXXXX", filename);
+	// The file is created exclusively, so an existing file or symlink by that name is never
+	// written through.
+#if !_WIN32
+	int fd = mkstemp(*tmp);
+	bool ok = fd != -1 && fchmod(fd, st.st_mode & 07777) == 0 &&
+		(st.st_gid == getegid() || fchown(fd, -1, st.st_gid) == 0);
+#if __linux__ || __APPLE__
+	if (ok) ok = copy_xattrs(filename, fd);
+#endif
+	FILE *f = ok ? fdopen(fd, "wb") : NULL;
+#else
+	int fd = _mktemp(*tmp) ?
+		_open(*tmp, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE) : -1;
+	FILE *f = fd != -1 ? _fdopen(fd, "wb") : NULL;
+#endif
+	if (f) return f;
+	if (fd != -1) close(fd), remove(*tmp);
+	return (free(*tmp), *tmp = NULL, NULL);
+}
+
+// Writes the given file's chunks to the given file, converting them a piece at a time if the
+// file has a conversion descriptor, and computes the hash of the bytes written. If *f* is NULL,
+// only converts the chunks in order to check that they can be.
+// Returns whether or not this was successful, with errno set if not.
+static bool write_chunks(struct FileWrite *w, FILE *f) {
+	w->hash = FNV_OFFSET;
+	if (w->cd == (iconv_t)-1) {
+		for (int i = 0; i < w->num_chunks; i++) {
+			if (f && fwrite(w->chunks[i], 1, w->lens[i], f) != w->lens[i]) return false;
+			w->hash = fnv1a(w->hash, w->chunks[i], w->lens[i]);
+		}
+		return true;
+	}
+	char buf[CONVERT_BUFFER_SIZE];
+	iconv(w->cd, NULL, NULL, NULL, NULL); // reset the conversion state
+	for (int i = 0; i <= w->num_chunks; i++) {
+		// Convert each chunk in turn, and then flush any output remaining in the conversion state.
+		char *inbuf = i < w->num_chunks ? (char *)w->chunks[i] : NULL;
+		size_t inbytesleft = inbuf ? w->lens[i] : 0, result;
+		do {
+			char *p = buf;
+			size_t outbytesleft = sizeof(buf), len;
+			result = iconv(w->cd, inbuf ? &inbuf : NULL, inbuf ? &inbytesleft : NULL, &p, &outbytesleft);
+			if (result == (size_t)-1 && errno != E2BIG) return (errno = EILSEQ, false);
+			if (len = p - buf, f && fwrite(buf, 1, len, f) != len) return false;
+			w->hash = fnv1a(w->hash, buf, len);
+		} while (result == (size_t)-1);
+	}
+	return true;
+}
+
+// Writes the given file's chunks to a temporary file next to it, flushes that file to disk,
+// and renames it over the original file so the original is never left partially written.
+// Files that `open_temporary_file()` cannot create a temporary file for are written in place,
+// but only after checking that any conversion succeeds, so that a failed one cannot clobber them.
+// This runs on a worker thread, so it must not call Lua.
+static void write_file(struct FileWrite *w) {
+#if !_WIN32
+	char *resolved = realpath(w->filename, NULL); // write through symlinks rather than replace them
+	const char *filename = resolved ? resolved : w->filename;
+#else
+	char *resolved = NULL;
+	const char *filename = w->filename;
+#endif
+	char *tmp = NULL;
+	FILE *f = open_temporary_file(filename, &tmp);
+	bool atomic = f != NULL, ok = atomic || w->cd == (iconv_t)-1 || write_chunks(w, NULL);
+	if (ok) ok = (f || (f = fopen(filename, "wb"))) && write_chunks(w, f);
+#if !_WIN32
+	if (ok) ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+#else
+	if (ok) ok = fflush(f) == 0 && _commit(_fileno(f)) == 0;
+#endif
+	if (f && fclose(f) != 0) ok = false;
+	if (ok && atomic) {
+#if !_WIN32
+		ok = rename(tmp, filename) == 0;
+#else
+		ok = MoveFileExA(tmp, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+		if (!ok) errno = EACCES;
+#endif
+	}
+	if (!ok) {
+		snprintf(w->error, sizeof(w->error), "%s: %s", w->filename, strerror(errno));
+		if (atomic) remove(tmp);
+	}
+	free(tmp), free(resolved);
+}
+
+// Entry point for a thread that writes a file.
+#if !_WIN32
+static void *write_file_thread(void *w) { return (write_file(w), NULL); }
+#else
+static DWORD WINAPI write_file_thread(void *w) { return (write_file(w), 0); }
+#endif
+
+// `io._write_files()` Lua function.
+// Writes a list of files, each one a table with a filename followed by chunks of text to write,
+// concurrently on worker threads, and returns a list of results for them, each `true` or an
+// error message, along with a list of hashes of the bytes written, as computed by `io._hash()`.
+// Returns only after all files have been written.
+// A file table's *buffer* field is a buffer whose text is written after any chunks, directly
+// from Scintilla rather than from a copy. Its *encoding* field is an encoding to convert its
+// UTF-8 text to while writing it. Chunks must not split multibyte characters.
+static int write_files_lua(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = lua_rawlen(L, 1), num_chunks = 0;
+	for (int i = 1; i <= n; i++) {
+		luaL_argcheck(L, lua_rawgeti(L, 1, i) == LUA_TTABLE, 1, "list of tables expected");
+		for (int j = 1; j <= (int)lua_rawlen(L, -1); j++)
+			luaL_argcheck(L, lua_rawgeti(L, -1, j) == LUA_TSTRING, 1, "strings expected"),
+				lua_pop(L, 1);
+		luaL_argcheck(L, lua_rawlen(L, -1) > 0, 1, "filename expected");
+		num_chunks += lua_rawlen(L, -1) - 1;
+		if (lua_getfield(L, -1, "buffer") != LUA_TNIL)
+			luaL_argcheck(L, is_type(L, -1, "ta_buffer"), 1, "Buffer expected"), num_chunks++;
+		lua_pop(L, 2); // buffer, file table
+	}
+	// Strings stay anchored in the argument table while worker threads read them.
+	struct FileWrite *writes = lua_newuserdatauv(L,
+		n * sizeof(struct FileWrite) + num_chunks * (sizeof(char *) + sizeof(size_t)) + 1, 0);
+	const char **chunks = (const char **)(writes + n);
+	size_t *lens = (size_t *)(chunks + num_chunks);
+	for (int i = 0; i < n; i++) {
+		struct FileWrite *w = &writes[i];
+		lua_rawgeti(L, 1, i + 1);
+		w->num_chunks = lua_rawlen(L, -1) - 1, w->chunks = chunks, w->lens = lens, w->error[0] = '\0';
+		w->hash = FNV_OFFSET;
+		w->filename = (lua_rawgeti(L, -1, 1), lua_tostring(L, -1)), lua_pop(L, 1);
+		for (int j = 0; j < w->num_chunks; j++)
+			*chunks++ = (lua_rawgeti(L, -1, j + 2), lua_tolstring(L, -1, lens++)), lua_pop(L, 1);
+		if (lua_getfield(L, -1, "buffer") != LUA_TNIL) {
+			// The text stays in place, since Scintilla only moves it when the buffer is modified.
+			SciObject *view = view_for_doc(L, -1);
+			*chunks++ = (const char *)SS(view, SCI_GETCHARACTERPOINTER, 0, 0);
+			*lens++ = SS(view, SCI_GETLENGTH, 0, 0), w->num_chunks++;
+		}
+		w->cd = lua_getfield(L, -2, "encoding") == LUA_TSTRING ?
+			iconv_open(lua_tostring(L, -1), "UTF-8") : (iconv_t)-1;
+		bool invalid = lua_type(L, -1) == LUA_TSTRING && w->cd == (iconv_t)-1;
+		lua_pop(L, 3); // encoding, buffer, file table
+		if (invalid) {
+			snprintf(w->error, sizeof(w->error), "%s: invalid encoding", w->filename);
+			w->threaded = false;
+			continue;
+		}
+#if !_WIN32
+		w->threaded = pthread_create(&w->thread, NULL, write_file_thread, w) == 0;
+#else
+		w->threaded = (w->thread = CreateThread(NULL, 0, write_file_thread, w, 0, NULL)) != NULL;
+#endif
+		if (!w->threaded) write_file(w);
+	}
+	lua_createtable(L, n, 0);
+	for (int i = 0; i < n; i++) {
+		struct FileWrite *w = &writes[i];
+#if !_WIN32
+		if (w->threaded) pthread_join(w->thread, NULL);
+#else
+		if (w->threaded) WaitForSingleObject(w->thread, INFINITE), CloseHandle(w->thread);
+#endif
+		if (w->cd != (iconv_t)-1) iconv_close(w->cd);
+		!w->error[0] ? lua_pushboolean(L, true) : (void)lua_pushstring(L, w->error);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_createtable(L, n, 0);
+	for (int i = 0; i < n; i++)
+		lua_pushinteger(L, (lua_Integer)writes[i].hash), lua_rawseti(L, -2, i + 1);
+	return 2;
+}
+
+// A portion of a list of files to search for text on a worker thread.
+struct FileSearch {
+	const char **filenames, *text;
+	size_t len;
+	bool match_case, *results, threaded;
+	int num_files;
+#if !_WIN32
+	pthread_t thread;
+#else
+	HANDLE thread;
+#endif
+};
+
+// Returns whether or not the given contents might contain the given text.
+// Case-insensitive matching only folds ASCII, and contents or text with other characters might
+// always match, since Unicode case folding is left to Scintilla.
+static bool may_contain(const char *s, size_t n, const char *text, size_t len, bool match_case) {
+	if (len == 0) return true;
+	if (!match_case)
+		for (size_t i = 0; i < n || i < len; i++)
+			if ((i < n && s[i] & 0x80) || (i < len && text[i] & 0x80)) return true;
+	for (size_t i = 0; i + len <= n; i++) {
+		if (match_case) {
+			const char *p = memchr(s + i, *text, n - len - i + 1);
+			if (!p) return false;
+			if (i = p - s, memcmp(p, text, len) == 0) return true;
+			continue;
+		}
+		size_t j = 0;
+		while (j < len && tolower((unsigned char)s[i + j]) == tolower((unsigned char)text[j])) j++;
+		if (j == len) return true;
+	}
+	return false;
+}
+
+// Reads each of the given job's files and records whether or not it might contain the job's
+// text. Files that cannot be read might, so that searching them reports the error.
+// Files are memory-mapped where possible so they are not copied.
+// This runs on a worker thread, so it must not call Lua.
+static void search_files(struct FileSearch *job) {
+	for (int i = 0; i < job->num_files; i++) {
+		bool *result = &job->results[i];
+		*result = true;
+#if !_WIN32
+		int fd = open(job->filenames[i], O_RDONLY);
+		struct stat st;
+		if (fd == -1) continue;
+		bool ok = fstat(fd, &st) == 0;
+		void *s = MAP_FAILED;
+		if (ok && st.st_size > 0) s = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		else if (ok) *result = job->len == 0;
+		if (s != MAP_FAILED)
+			*result = may_contain(s, st.st_size, job->text, job->len, job->match_case),
+			munmap(s, st.st_size);
+		close(fd);
+#else
+		FILE *f = fopen(job->filenames[i], "rb");
+		if (!f) continue;
+		long n = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+		char *s = n >= 0 ? malloc(n + 1) : NULL;
+		if (s && (rewind(f), fread(s, 1, n, f) == (size_t)n))
+			*result = may_contain(s, n, job->text, job->len, job->match_case);
+		free(s), fclose(f);
+#endif
+	}
+}
+
+// Entry point for a thread that searches files.
+#if !_WIN32
+static void *search_files_thread(void *job) { return (search_files(job), NULL); }
+#else
+static DWORD WINAPI search_files_thread(void *job) { return (search_files(job), 0); }
+#endif
+
+// `io._may_contain()` Lua function.
+// Reads the given list of files concurrently on worker threads and returns a list of whether
+// or not each one might contain the given text (with the given case sensitivity). A file that
+// might not is certain not to, so it does not need to be searched. Returns only after all files
+// have been read.
+static int may_contain_lua(lua_State *L) {
+	int n = (luaL_checktype(L, 1, LUA_TTABLE), lua_rawlen(L, 1));
+	size_t len;
+	const char *text = luaL_checklstring(L, 2, &len);
+	bool match_case = lua_toboolean(L, 3);
+	for (int i = 1; i <= n; lua_pop(L, 1), i++)
+		luaL_argcheck(L, lua_rawgeti(L, 1, i) == LUA_TSTRING, 1, "strings expected");
+	// Strings stay anchored in the argument table while worker threads read them.
+	const char **filenames = lua_newuserdatauv(L, n * (sizeof(char *) + sizeof(bool)) + 1, 0);
+	bool *results = (bool *)(filenames + n);
+	for (int i = 0; i < n; lua_pop(L, 1), i++)
+		filenames[i] = (lua_rawgeti(L, 1, i + 1), lua_tostring(L, -1));
+	// Split files between jobs, searching the first one on this thread.
+	int num_jobs = n < MAX_SEARCH_THREADS ? (n > 0 ? n : 1) : MAX_SEARCH_THREADS;
+	struct FileSearch jobs[MAX_SEARCH_THREADS];
+	for (int i = 0; i < num_jobs; i++) {
+		int start = n * i / num_jobs, end = n * (i + 1) / num_jobs;
+		struct FileSearch *job = &jobs[i];
+		job->filenames = filenames + start, job->num_files = end - start, job->text = text,
+		job->len = len, job->match_case = match_case, job->results = results + start,
+		job->threaded = false;
+#if !_WIN32
+		if (i > 0) job->threaded = pthread_create(&job->thread, NULL, search_files_thread, job) == 0;
+#else
+		if (i > 0)
+			job->threaded = (job->thread = CreateThread(NULL, 0, search_files_thread, job, 0, NULL));
+#endif
+		if (i > 0 && !job->threaded) search_files(job);
+	}
+	search_files(&jobs[0]);
+	for (int i = 0; i < num_jobs; i++) {
+#if !_WIN32
+		if (jobs[i].threaded) pthread_join(jobs[i].thread, NULL);
+#else
+		if (jobs[i].threaded)
+			WaitForSingleObject(jobs[i].thread, INFINITE), CloseHandle(jobs[i].thread);
+#endif
+	}
+	lua_createtable(L, n, 0);
+	for (int i = 0; i < n; i++) lua_pushboolean(L, results[i]), lua_rawseti(L, -2, i + 1);
+	return 1;
+}
+
+// `io._hash()` Lua function.
+// Returns a hash of the given string, or of the concatenation of the given list of strings.
+static int hash_lua(lua_State *L) {
+	uint64_t h = FNV_OFFSET;
+	size_t len;
+	if (lua_type(L, 1) == LUA_TTABLE)
+		for (int i = 1; i <= (int)lua_rawlen(L, 1); i++) {
+			luaL_argcheck(L, lua_rawgeti(L, 1, i) == LUA_TSTRING, 1, "strings expected");
+			const char *s = lua_tolstring(L, -1, &len);
+			h = fnv1a(h, s, len), lua_pop(L, 1);
+		}
+	else {
+		const char *s = luaL_checklstring(L, 1, &len);
+		h = fnv1a(h, s, len);
+	}
+	return (lua_pushinteger(L, (lua_Integer)h), 1);
+}
+
+// `io._hash_file()` Lua function.
+// Returns the hash of the given file's contents, as computed by `io._hash()`, or `nil` if the
+// file could not be read.
+static int hash_file_lua(lua_State *L) {
+	uint64_t h;
+	lua_Integer size;
+	bool ok = hash_file(luaL_checkstring(L, 1), &h, &size);
+	return (ok ? lua_pushinteger(L, (lua_Integer)h) : lua_pushnil(L), 1);
+}
+
+// Watch for changes to open files.
+// On Linux and Windows, the directories of watched files are watched so that files replaced by
+// renaming over them (as many programs do when saving) are still reported. With kqueue, watched
+// files themselves are watched, and they are watched again after being replaced.
+struct Watch {
+	char *path; // watched directory (with a trailing separator) or file
+	int refs; // number of watched files that need this watch
+#if __linux__
+	int wd; // -1 if the directory was removed
+#elif _WIN32
+	HANDLE dir;
+	OVERLAPPED overlapped;
+	DWORD buf[WATCH_BUFFER_SIZE / sizeof(DWORD)]; // DWORD-aligned for FILE_NOTIFY_INFORMATION
+#elif HAVE_KQUEUE
+	int fd; // -1 while the file does not exist
+#endif
+};
+static struct Watch **watches; // pointers, since Windows writes to watches asynchronously
+static int num_watches;
+static bool watching; // whether check_watches() is scheduled
+static bool polling; // whether changes are polled for, since the platform cannot watch for them
+static bool changes_seen; // whether file_changes_ready() read changes since check_watches() ran
+static bool changes_lost; // whether notices overflowed
+static double changes_start; // time of the first unreported change
+#if __linux__
+static int inotify_fd = -1;
+#elif HAVE_KQUEUE
+static int kqueue_fd = -1;
+#ifndef O_EVTONLY
+#define O_EVTONLY O_RDONLY
+#endif
+#endif
+
+// Returns a newly allocated path to watch for changes to the given file, or NULL if the file
+// cannot be watched.
+static char *watch_path(const char *filename) {
+	size_t len = strlen(filename);
+#if __linux__
+	while (len > 0 && filename[len - 1] != '/') len--;
+	if (len == 0) return NULL;
+#elif _WIN32
+	while (len > 0 && filename[len - 1] != '/' && filename[len - 1] != '\\') len--;
+	if (len == 0) return NULL;
+#elif !HAVE_KQUEUE
+	return NULL;
+#endif
+	char *path = malloc(len + 1);
+	if (path) memcpy(path, filename, len), path[len] = '\0';
+	return path;
+}
+
+// Returns the index of the watch for the given path, or -1 if there is none.
+static int find_watch(const char *path) {
+	for (int i = 0; i < num_watches; i++)
+		if (strcmp(watches[i]->path, path) == 0) return i;
+	return -1;
+}
+
+#if _WIN32
+// Requests notice of the next changes in the given watch's directory.
+static bool read_directory_changes(struct Watch *w) {
+	DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE |
+		FILE_NOTIFY_CHANGE_LAST_WRITE;
+	memset(&w->overlapped, 0, sizeof(OVERLAPPED));
+	return ReadDirectoryChangesW(
+		w->dir, w->buf, sizeof(w->buf), FALSE, filter, NULL, &w->overlapped, NULL);
+}
+#elif HAVE_KQUEUE
+// Opens the given watch's file and registers it with kqueue, leaving the watch's fd -1 if the
+// file could not be opened.
+static void open_watched_file(struct Watch *w) {
+	if ((w->fd = open(w->path, O_EVTONLY | O_CLOEXEC)) == -1) return;
+	struct kevent event;
+	EV_SET(&event, w->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+		NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME, 0, 0);
+	if (kevent(kqueue_fd, &event, 1, NULL, 0, NULL) == -1) close(w->fd), w->fd = -1;
+}
+#endif
+
+// Starts the given watch, and returns whether or not it was successful.
+static bool start_watch(struct Watch *w) {
+#if __linux__
+	if (inotify_fd == -1) {
+		if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) return false;
+		polling = !watch_changes(inotify_fd);
+	}
+	int mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+	return (w->wd = inotify_add_watch(inotify_fd, w->path, mask)) != -1;
+#elif _WIN32
+	w->dir = CreateFileA(w->path, FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (w->dir == INVALID_HANDLE_VALUE) return false;
+	polling = true; // completed requests are checked for rather than waited on
+	return read_directory_changes(w) || (CloseHandle(w->dir), false);
+#elif HAVE_KQUEUE
+	if (kqueue_fd == -1) {
+		if ((kqueue_fd = kqueue()) == -1) return false;
+		polling = !watch_changes(kqueue_fd);
+	}
+	return (open_watched_file(w), w->fd != -1);
+#else
+	return false;
+#endif
+}
+
+// Stops the given watch and frees it.
+static void free_watch(struct Watch *w) {
+#if __linux__
+	if (w->wd != -1) inotify_rm_watch(inotify_fd, w->wd);
+#elif _WIN32
+	// Wait for the canceled request to finish so the system no longer writes to the buffer.
+	DWORD len;
+	CancelIo(w->dir), GetOverlappedResult(w->dir, &w->overlapped, &len, TRUE), CloseHandle(w->dir);
+#elif HAVE_KQUEUE
+	if (w->fd != -1) close(w->fd); // also removes its kevent
+#endif
+	free(w->path), free(w);
+}
+
+// Stops and frees all file watches.
+static void free_watches() {
+	for (int i = 0; i < num_watches; i++) free_watch(watches[i]);
+	free(watches), watches = NULL, num_watches = 0;
+#if __linux__
+	if (inotify_fd != -1) watch_changes(-1), close(inotify_fd), inotify_fd = -1;
+#elif HAVE_KQUEUE
+	if (kqueue_fd != -1) watch_changes(-1), close(kqueue_fd), kqueue_fd = -1;
+#endif
+}
+
+// Adds the given changed file in the given watched path to the table of changes on the top of
+// the Lua stack.
+static void add_change(lua_State *L, const char *path, const char *name, size_t len) {
+	lua_pushstring(L, path), lua_pushlstring(L, name, len), lua_concat(L, 2);
+	lua_pushboolean(L, true), lua_rawset(L, -3);
+}
+
+// Reads pending changes to watched files without blocking, adds them to the table of changes
+// on the top of the Lua stack, and returns whether or not there were any.
+static bool read_changes(lua_State *L) {
+	bool changed = false;
+#if __linux__
+	char buf[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	for (ssize_t len; (len = read(inotify_fd, buf, sizeof(buf))) > 0;)
+		for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p, changed = true;
+			if (event->mask & IN_Q_OVERFLOW) {
+				changes_lost = true;
+				continue;
+			}
+			int i = 0;
+			while (i < num_watches && watches[i]->wd != event->wd) i++;
+			if (i == num_watches) continue; // already stopped
+			if (event->mask & IN_IGNORED)
+				watches[i]->wd = -1; // directory was removed
+			else if (event->len > 0)
+				add_change(L, watches[i]->path, event->name, strlen(event->name));
+		}
+#elif _WIN32
+	for (int i = 0; i < num_watches; i++) {
+		struct Watch *w = watches[i];
+		DWORD len;
+		if (!GetOverlappedResult(w->dir, &w->overlapped, &len, FALSE)) continue; // none yet
+		changed = true;
+		if (len == 0) changes_lost = true; // notices overflowed the buffer
+		for (FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)w->buf; len > 0;
+				 info = (FILE_NOTIFY_INFORMATION *)((char *)info + info->NextEntryOffset)) {
+			char name[MAX_PATH * MB_LEN_MAX];
+			int n = WideCharToMultiByte(CP_ACP, 0, info->FileName,
+				info->FileNameLength / sizeof(WCHAR), name, sizeof(name), NULL, NULL);
+			if (n > 0 && info->Action != FILE_ACTION_REMOVED &&
+				info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+				add_change(L, w->path, name, n);
+			if (info->NextEntryOffset == 0) break;
+		}
+		read_directory_changes(w);
+	}
+#elif HAVE_KQUEUE
+	struct kevent kevents[64];
+	struct timespec timeout = {0, 0};
+	int n;
+	do {
+		n = kevent(kqueue_fd, NULL, 0, kevents, 64, &timeout);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < num_watches; j++) {
+				struct Watch *w = watches[j];
+				if (w->fd != (int)kevents[i].ident) continue;
+				add_change(L, w->path, "", 0), changed = true;
+				if (kevents[i].fflags & (NOTE_DELETE | NOTE_RENAME))
+					close(w->fd), w->fd = -1; // replaced; watched again below
+				break;
+			}
+	} while (n == 64);
+	for (int i = 0; i < num_watches; i++)
+		if (watches[i]->fd == -1 && (open_watched_file(watches[i]), watches[i]->fd != -1))
+			add_change(L, watches[i]->path, "", 0), changed = true; // replacement exists now
+#endif
+	return changed;
+}
+
+// Pushes onto the Lua stack the table of changes not yet reported, creating it if necessary.
+static void push_changes(lua_State *L) {
+	if (lua_getfield(L, LUA_REGISTRYINDEX, CHANGES) == LUA_TTABLE) return;
+	lua_pop(L, 1), lua_newtable(L), lua_pushvalue(L, -1), lua_setfield(L, LUA_REGISTRYINDEX, CHANGES);
+}
+
+// Returns whether or not watched files need to be checked for changes even when no notices
+// arrive: either the platform cannot watch for notices, or (with kqueue) a replaced file does
+// not exist yet and has to be watched again once it does.
+static bool must_poll() {
+#if HAVE_KQUEUE
+	for (int i = 0; i < num_watches; i++)
+		if (watches[i]->fd == -1) return true;
+#endif
+	return polling;
+}
+
+// Reads changes to watched files, and once a burst of them ends (or has continued for
+// `WATCH_MAX_DELAY` seconds), calls the function registered by `io._watch_files()` with a list
+// of the changed files and whether or not some changes may have been missed.
+// This is a timeout function. It is scheduled by the first notice of a burst of changes, and
+// stops repeating once they have been reported, unless watched files must be polled.
+static bool check_watches(int *unused) {
+	if (!lua || num_watches == 0) return (watching = false, false);
+	push_changes(lua);
+	int changes = lua_gettop(lua);
+	bool changed = read_changes(lua) || changes_seen, pending = changes_lost;
+	changes_seen = false;
+	if (lua_pushnil(lua), lua_next(lua, changes)) lua_pop(lua, 2), pending = true;
+	if (!pending) return (lua_pop(lua, 1), changes_start = 0, watching = must_poll());
+	double now = clock_monotonic();
+	if (changes_start == 0) changes_start = now;
+	if (changed && now - changes_start < WATCH_MAX_DELAY) return (lua_pop(lua, 1), true);
+	lua_pushnil(lua), lua_setfield(lua, LUA_REGISTRYINDEX, CHANGES);
+	bool lost = changes_lost;
+	changes_lost = false, changes_start = 0;
+	if (lua_getfield(lua, LUA_REGISTRYINDEX, WATCH) != LUA_TFUNCTION) return (lua_pop(lua, 2), true);
+	lua_newtable(lua);
+	int n = 0;
+	for (lua_pushnil(lua); lua_next(lua, changes); lua_pop(lua, 1))
+		lua_pushvalue(lua, -2), lua_rawseti(lua, changes + 2, ++n);
+	lua_pushboolean(lua, lost);
+	double start = profiling ? now : 0;
+	if (lua_pcall(lua, 2, 0, 0) != LUA_OK)
+		show_error("File Watch Error", lua_tostring(lua, -1)), lua_pop(lua, 1);
+	if (profiling) profile(lua, "file watch", start, true);
+	return (lua_pop(lua, 1), true); // check once more for changes made while reporting these
+}
+
+void file_changes_ready() {
+	if (!lua || num_watches == 0) return;
+	push_changes(lua);
+	if (read_changes(lua)) changes_seen = true;
+	lua_pop(lua, 1);
+	if (!changes_seen) return;
+	if (changes_start == 0) changes_start = clock_monotonic();
+	if (!watching) watching = add_timeout(WATCH_INTERVAL, check_watches, NULL);
+}
+
+// `io._watch_file()` Lua function.
+// Watches the given file for changes, and returns the filename watched, or `nil` if the file
+// is not being watched. Any symlinks in that filename are resolved, since changes to a
+// symlink's target are not reported in the symlink's directory.
+// Changes are reported to the function registered by `io._watch_files()` using the filename
+// watched, which is also the filename to pass to `io._unwatch_file()`. Files watched more than
+// once must be unwatched as many times.
+static int watch_file_lua(lua_State *L) {
+	const char *filename = luaL_checkstring(L, 1);
+#if !_WIN32
+	char *resolved = realpath(filename, NULL);
+	if (resolved) lua_pushstring(L, resolved), free(resolved), filename = lua_tostring(L, -1);
+#endif
+	char *path = watch_path(filename);
+	if (!path) return (lua_pushnil(L), 1);
+	int i = find_watch(path);
+	if (i != -1) return (free(path), watches[i]->refs++, lua_pushstring(L, filename), 1);
+	struct Watch **resized = realloc(watches, (num_watches + 1) * sizeof(struct Watch *)), *w = NULL;
+	if (resized) watches = resized;
+	if (!resized || !(w = calloc(1, sizeof(struct Watch))) || (w->path = path, !start_watch(w)))
+		return (free(path), free(w), lua_pushnil(L), 1);
+	watches[num_watches++] = w, w->refs = 1;
+	if (polling && !watching && !(watching = add_timeout(WATCH_INTERVAL, check_watches, NULL)))
+		return (free_watch(watches[--num_watches]), lua_pushnil(L), 1);
+	return (lua_pushstring(L, filename), 1);
+}
+
+// `io._unwatch_file()` Lua function.
+// Stops watching the given file, which was watched by `io._watch_file()`.
+static int unwatch_file_lua(lua_State *L) {
+	char *path = watch_path(luaL_checkstring(L, 1));
+	int i = path ? find_watch(path) : -1;
+	if (free(path), i == -1 || --watches[i]->refs > 0) return 0;
+	return (free_watch(watches[i]), watches[i] = watches[--num_watches], 0);
+}
+
+// `io._watch_files()` Lua function.
+// Registers the function to call with changes to files watched by `io._watch_file()`.
+static int watch_files_lua(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	return (lua_pushvalue(L, 1), lua_setfield(L, LUA_REGISTRYINDEX, WATCH), 0);
+}
+
+// `ui.memory_stats()` Lua function.
+static int memory_stats(lua_State *L) {
+	lua_createtable(L, 0, 3);
+	lua_createtable(L, 0, 3);
+	lua_pushinteger(L, lua_gc(L, LUA_GCCOUNT) * 1024 + lua_gc(L, LUA_GCCOUNTB)),
+		lua_setfield(L, -2, "heap");
+	lua_pushinteger(L, pool.reserved), lua_setfield(L, -2, "pool");
+	lua_pushinteger(L, pool.free_bytes + (pool.end - pool.next)), lua_setfield(L, -2, "pool_free");
+	lua_setfield(L, -2, "lua");
+	lua_getfield(L, LUA_REGISTRYINDEX, BUFFERS);
+	int n = lua_rawlen(L, -1);
+	lua_createtable(L, n, 0);
+	for (int i = 1; i <= n; i++) {
+		lua_rawgeti(L, -2, i);
+		SciObject *view = view_for_doc(L, -1);
+		sptr_t length = SS(view, SCI_GETLENGTH, 0, 0);
+		bool styled = !(SS(view, SCI_GETDOCUMENTOPTIONS, 0, 0) & SC_DOCUMENTOPTION_STYLES_NONE);
+		lua_createtable(L, 0, 4);
+		lua_pushvalue(L, -2), lua_setfield(L, -2, "buffer");
+		lua_pushinteger(L, length), lua_setfield(L, -2, "text");
+		lua_pushinteger(L, styled ? length : 0), lua_setfield(L, -2, "styles");
+		lua_pushinteger(L, SS(view, SCI_GETLINECOUNT, 0, 0)), lua_setfield(L, -2, "lines");
+		lua_replace(L, -2), lua_rawseti(L, -2, i); // replace buffer
+	}
+	lua_replace(L, -2), lua_setfield(L, -2, "buffers"); // replace ta_buffers
+	lua_newtable(L);
+	for (lua_pushnil(L); lua_next(L, LUA_REGISTRYINDEX); lua_pop(L, 1)) {
+		Process *proc = lua_islightuserdata(L, -2) ? luaL_testudata(L, -1, "ta_spawn") : NULL;
+		if (!proc) continue;
+		struct ProcessOutput *output = process_output_of(proc);
+		lua_createtable(L, 0, 3);
+		lua_pushinteger(L, output->len[0]), lua_setfield(L, -2, "stdout");
+		lua_pushinteger(L, output->len[1]), lua_setfield(L, -2, "stderr");
+		int buffers = (output->buf[0] != NULL) + (output->buf[1] != NULL);
+		lua_pushinteger(L, buffers * PROCESS_OUTPUT_SIZE), lua_setfield(L, -2, "reserved");
+		lua_rawseti(L, -4, lua_rawlen(L, -4) + 1);
+	}
+	return (lua_setfield(L, -2, "processes"), 1);
+}
+
 // Initializes or re-initializes the Lua state and with the given command-line arguments.
 // Populates the state with global variables and functions, runs the 'core/init.lua' script,
 // and returns `true` on success.
 static bool init_lua(int argc, char **argv) {
-	lua_State *L = !lua ? luaL_newstate() : lua;
+	lua_State *L = !lua ? lua_newstate(lua_alloc, NULL) : lua;
 	if (!lua) {
+		lua_atpanic(L, lua_panic), lua_setwarnf(L, lua_warning, NULL);
 		lua_newtable(L);
 		for (int i = 0; i < argc; i++) lua_pushstring(L, argv[i]), lua_rawseti(L, -2, i);
 		lua_setfield(L, LUA_REGISTRYINDEX, ARG);
 		lua_newtable(L), lua_setfield(L, LUA_REGISTRYINDEX, BUFFERS);
 		lua_newtable(L), lua_setfield(L, LUA_REGISTRYINDEX, VIEWS);
+		for (int i = 0; i < argc; i++)
+			if (strcmp("-P", argv[i]) == 0 || strcmp("--profile", argv[i]) == 0)
+				profiling = true;
+			else if (strcmp("-B", argv[i]) == 0 || strcmp("--batch", argv[i]) == 0 ||
+				strcmp("-b", argv[i]) == 0 || strcmp("--bench", argv[i]) == 0)
+				batch = true; // benchmarks also run headless and quit after initializing
+		lua_newtable(L), lua_setfield(L, LUA_REGISTRYINDEX, PROFILE);
+		lua_newtable(L), lua_setfield(L, LUA_REGISTRYINDEX, TRACE);
 	} else { // clear package.loaded and _G
 		lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
 		while (lua_pushnil(L), lua_next(L, -2))
@@ -843,7 +2314,7 @@ static bool init_lua(int argc, char **argv) {
 			lua_call(L, 4, 1), lua_setglobal(L, "arg"); // arg = table.move(arg, 0, #len + n, -n)
 			bool ok = luaL_dofile(L, argv[i + 1]) == LUA_OK;
 			if (!ok) fprintf(stderr, "%s\n", lua_tostring(L, -1));
-			return (lua_close(L), lua = NULL, exit_status = ok ? 0 : 1, false);
+			return (lua_close(L), lua = NULL, free_pool(), exit_status = ok ? 0 : 1, false);
 		}
 
 	lua_newtable(L);
@@ -870,13 +2341,16 @@ static bool init_lua(int argc, char **argv) {
 	lua_pushcfunction(L, save_dialog_lua), lua_setfield(L, -2, "save");
 	lua_pushcfunction(L, progress_dialog_lua), lua_setfield(L, -2, "progress");
 	lua_pushcfunction(L, list_dialog_lua), lua_setfield(L, -2, "list");
+	lua_pushcfunction(L, filter_list_lua), lua_setfield(L, -2, "_filter");
 	lua_setfield(L, -2, "dialogs");
 	lua_pushcfunction(L, get_split_table), lua_setfield(L, -2, "get_split_table");
 	lua_pushcfunction(L, goto_view), lua_setfield(L, -2, "goto_view");
 	lua_pushcfunction(L, menu), lua_setfield(L, -2, "menu");
 	lua_pushcfunction(L, popup_menu_lua), lua_setfield(L, -2, "popup_menu");
 	lua_pushcfunction(L, update_ui_lua), lua_setfield(L, -2, "update");
+	lua_pushcfunction(L, wait_ui_lua), lua_setfield(L, -2, "_wait");
 	lua_pushcfunction(L, suspend_lua), lua_setfield(L, -2, "suspend");
+	lua_pushcfunction(L, memory_stats), lua_setfield(L, -2, "memory_stats");
 	set_metatable(L, -1, "ta_ui", ui_index, ui_newindex);
 	lua_setglobal(L, "ui");
 
@@ -884,11 +2358,25 @@ static bool init_lua(int argc, char **argv) {
 	lua_pushcfunction(L, quit_lua), lua_setglobal(L, "quit");
 	lua_pushcfunction(L, reset), lua_setglobal(L, "reset");
 	lua_pushcfunction(L, add_timeout_lua), lua_setglobal(L, "timeout");
+	lua_pushcfunction(L, loadfile_lua), lua_setglobal(L, "loadfile");
+	lua_pushcfunction(L, dofile_lua), lua_setglobal(L, "dofile");
+	lua_getglobal(L, "package"), lua_getfield(L, -1, "searchers"),
+		lua_pushcfunction(L, searcher_lua), lua_rawseti(L, -2, 2), lua_pop(L, 2); // replace Lua's
 
 	lua_getglobal(L, "string"), lua_pushcfunction(L, iconv_lua), lua_setfield(L, -2, "iconv"),
-		lua_pop(L, 1);
+		lua_pushcfunction(L, iconv_open_lua), lua_setfield(L, -2, "iconv_open"),
+		lua_pushcfunction(L, is_utf8_lua), lua_setfield(L, -2, "is_utf8"), lua_pop(L, 1);
 	lua_getglobal(L, "os"), lua_pushcfunction(L, spawn_lua), lua_setfield(L, -2, "spawn"),
-		lua_pop(L, 1);
+		lua_pushcfunction(L, clock_lua), lua_setfield(L, -2, "_clock"), lua_pop(L, 1);
+	lua_getglobal(L, "io"), lua_pushcfunction(L, write_files_lua),
+		lua_setfield(L, -2, "_write_files"), lua_pushcfunction(L, may_contain_lua),
+		lua_setfield(L, -2, "_may_contain"), lua_pushcfunction(L, read_stdin_lua),
+		lua_setfield(L, -2, "_read_stdin"), lua_pushcfunction(L, hash_lua),
+		lua_setfield(L, -2, "_hash"), lua_pushcfunction(L, hash_file_lua),
+		lua_setfield(L, -2, "_hash_file"), lua_pushcfunction(L, watch_file_lua),
+		lua_setfield(L, -2, "_watch_file"), lua_pushcfunction(L, unwatch_file_lua),
+		lua_setfield(L, -2, "_unwatch_file"), lua_pushcfunction(L, watch_files_lua),
+		lua_setfield(L, -2, "_watch_files"), lua_pop(L, 1);
 
 	lua_getfield(L, LUA_REGISTRYINDEX, ARG), lua_setglobal(L, "arg");
 	lua_getfield(L, LUA_REGISTRYINDEX, BUFFERS), lua_setglobal(L, "_BUFFERS");
@@ -898,13 +2386,25 @@ static bool init_lua(int argc, char **argv) {
 	lua_pushboolean(L, true), lua_setglobal(L, get_platform());
 	lua_pushstring(L, get_charset()), lua_setglobal(L, "_CHARSET");
 	lua_pushstring(L, !is_dark_mode() ? "light" : "dark"), lua_setglobal(L, "_THEME");
+	if (profiling) {
+		lua_newtable(L);
+		lua_pushcfunction(L, clock_lua), lua_setfield(L, -2, "clock");
+		lua_pushcfunction(L, record_lua), lua_setfield(L, -2, "record");
+		lua_getfield(L, LUA_REGISTRYINDEX, PROFILE), lua_setfield(L, -2, "stats");
+		lua_getfield(L, LUA_REGISTRYINDEX, TRACE), lua_setfield(L, -2, "trace");
+		lua_setglobal(L, "_PROFILE");
+	}
 
+	double start = profiling ? clock_monotonic() : 0;
 	if (lua = L, !run_file("core/init.lua"))
-		return (lua_close(L), lua = NULL, exit_status = 1, false);
+		return (lua_close(L), lua = NULL, free_pool(), exit_status = 1, false);
+	if (profiling) profile(L, "startup: core/init.lua", start, true);
 	lua_getglobal(L, "_SCINTILLA");
 	lua_getfield(L, -1, "constants"), lua_setfield(L, LUA_REGISTRYINDEX, "ta_constants");
 	lua_getfield(L, -1, "functions"), lua_setfield(L, LUA_REGISTRYINDEX, "ta_functions");
 	lua_getfield(L, -1, "properties"), lua_setfield(L, LUA_REGISTRYINDEX, "ta_properties");
+	lua_getfield(L, -1, "events"), lua_setfield(L, LUA_REGISTRYINDEX, "ta_events");
+	lua_newtable(L), lua_setfield(L, LUA_REGISTRYINDEX, "ta_methods"); // cache of function closures
 	lua_pop(L, 1); // _SCINTILLA
 	return (exit_status = 0, true);
 }
@@ -926,40 +2426,92 @@ static void view_focused(SciObject *view) {
 	if (!initing && !closing) emit("view_after_switch", -1);
 }
 
-// Emits the given Scintilla notification to Lua.
+// Pushes onto the Lua stack the value of the given Scintilla notification field.
+// Fields not exposed to Lua are pushed as nil.
+static void push_notification_field(lua_State *L, SCNotification *n, const char *field) {
+	if (strcmp(field, "position") == 0)
+		lua_pushinteger(L, n->position + 1);
+	else if (strcmp(field, "ch") == 0)
+		lua_pushinteger(L, n->ch);
+	else if (strcmp(field, "modifiers") == 0)
+		lua_pushinteger(L, n->modifiers);
+	else if (strcmp(field, "modification_type") == 0)
+		lua_pushinteger(L, n->modificationType);
+	else if (strcmp(field, "text") == 0 && n->text)
+		lua_pushlstring(L, n->text, n->length ? (size_t)n->length : strlen(n->text));
+	else if (strcmp(field, "length") == 0)
+		lua_pushinteger(L, n->length);
+	else if (strcmp(field, "lines_added") == 0)
+		lua_pushinteger(L, n->linesAdded);
+	else if (strcmp(field, "line") == 0)
+		lua_pushinteger(L, n->line + 1);
+	else if (strcmp(field, "margin") == 0)
+		lua_pushinteger(L, n->margin + 1);
+	else if (strcmp(field, "list_type") == 0)
+		lua_pushinteger(L, n->listType);
+	else if (strcmp(field, "x") == 0)
+		lua_pushinteger(L, n->x);
+	else if (strcmp(field, "y") == 0)
+		lua_pushinteger(L, n->y);
+	else if (strcmp(field, "updated") == 0)
+		lua_pushinteger(L, n->updated);
+	else
+		lua_pushnil(L);
+}
+
+// Emits the given Scintilla notification to Lua as its named event.
+// Only the fields listed in the notification's `_SCINTILLA.events` entry are passed, and
+// notifications without any connected handlers (per `events._notification_mask`) are skipped.
 static void emit_notification(SCNotification *n) {
 	if (n->nmhdr.code == SCN_KEY) return; // platforms are handling key events; avoid duplicates
-	lua_newtable(lua);
-	lua_pushinteger(lua, n->nmhdr.code), lua_setfield(lua, -2, "code");
-	lua_pushinteger(lua, n->position + 1), lua_setfield(lua, -2, "position");
-	lua_pushinteger(lua, n->ch), lua_setfield(lua, -2, "ch");
-	lua_pushinteger(lua, n->modifiers), lua_setfield(lua, -2, "modifiers");
-	lua_pushinteger(lua, n->modificationType), lua_setfield(lua, -2, "modification_type");
-	if (n->text)
-		lua_pushlstring(lua, n->text, n->length ? (size_t)n->length : strlen(n->text)),
-			lua_setfield(lua, -2, "text");
-	lua_pushinteger(lua, n->length), lua_setfield(lua, -2, "length");
-	lua_pushinteger(lua, n->linesAdded), lua_setfield(lua, -2, "lines_added");
-	// lua_pushinteger(lua, n->message), lua_setfield(lua, -2, "message");
-	// lua_pushinteger(lua, n->wParam), lua_setfield(lua, -2, "wParam");
-	// lua_pushinteger(lua, n->lParam), lua_setfield(lua, -2, "lParam");
-	lua_pushinteger(lua, n->line + 1), lua_setfield(lua, -2, "line");
-	// lua_pushinteger(lua, n->foldLevelNow), lua_setfield(lua, -2, "fold_level_now");
-	// lua_pushinteger(lua, n->foldLevelPrev), lua_setfield(lua, -2, "fold_level_prev");
-	lua_pushinteger(lua, n->margin + 1), lua_setfield(lua, -2, "margin");
-	lua_pushinteger(lua, n->listType), lua_setfield(lua, -2, "list_type");
-	lua_pushinteger(lua, n->x), lua_setfield(lua, -2, "x");
-	lua_pushinteger(lua, n->y), lua_setfield(lua, -2, "y");
-	// lua_pushinteger(lua, n->token), lua_setfield(lua, -2, "token");
-	// lua_pushinteger(lua, n->annotationLinesAdded), lua_setfield(lua, -2, "annotation_lines_added");
-	lua_pushinteger(lua, n->updated), lua_setfield(lua, -2, "updated");
-	// lua_pushinteger(lua, n->listCompletionMethod), lua_setfield(lua, -2, "list_completion_method");
-	// lua_pushinteger(lua, n->characterSource), lua_setfield(lua, -2, "character_source");
-	emit("SCN", LUA_TTABLE, luaL_ref(lua, LUA_REGISTRYINDEX), -1);
+	unsigned int bit = n->nmhdr.code - SCN_STYLENEEDED; // first notification code
+	int top = lua_gettop(lua);
+	if (bit >= 64 || lua_getglobal(lua, "events") != LUA_TTABLE) {
+		lua_settop(lua, top);
+		return;
+	}
+	bool subscribed = (lua_getfield(lua, -1, "_notification_mask"), lua_tointeger(lua, -1)) &
+		((lua_Integer)1 << bit);
+	lua_pop(lua, 1); // mask
+	// Event table is of the form {name, field1, field2, ...}.
+	if (!subscribed || lua_getfield(lua, -1, "emit") != LUA_TFUNCTION ||
+		lua_getfield(lua, LUA_REGISTRYINDEX, "ta_events") != LUA_TTABLE ||
+		lua_rawgeti(lua, -1, n->nmhdr.code) != LUA_TTABLE) {
+		lua_settop(lua, top);
+		return;
+	}
+	int iface = lua_absindex(lua, -1), nargs = lua_rawlen(lua, iface);
+	lua_checkstack(lua, nargs + 1);
+	lua_rawgeti(lua, iface, 1); // name
+	for (int i = 2; i <= nargs; i++)
+		push_notification_field(lua, n, (lua_rawgeti(lua, iface, i), lua_tostring(lua, -1))),
+			lua_replace(lua, -2);
+	lua_rotate(lua, iface - 1, -2), lua_pop(lua, 2); // ta_events, iface
+	if (lua_pcall(lua, nargs, 0, 0) != LUA_OK)
+		// An error occurred within `events.emit()` itself, not an event handler.
+		show_error("Error", lua_tostring(lua, -1)), lua_pop(lua, 1); // error
+	lua_pop(lua, 1), schedule_gc(); // events
+}
+
+// Increments the `_edits` count of the given view's buffer for a text insertion or deletion.
+// Lua is only notified of modifications in the focused view, so this count lets it detect
+// modifications made elsewhere (e.g. to buffers in the background). Modifications to the
+// focused view's buffer are counted once, by the focused view, before Lua is notified of them.
+static void count_edit(SciObject *view) {
+	sptr_t doc = SS(view, SCI_GETDOCPOINTER, 0, 0);
+	if (view != focused_view && focused_view && doc == SS(focused_view, SCI_GETDOCPOINTER, 0, 0))
+		return;
+	if (lua_pushdoc(lua, doc), lua_istable(lua, -1))
+		lua_pushstring(lua, "_edits"), lua_pushvalue(lua, -1), lua_rawget(lua, -3),
+			lua_pushinteger(lua, lua_tointeger(lua, -1) + 1), lua_replace(lua, -2), lua_rawset(lua, -3);
+	lua_pop(lua, 1); // buffer
 }
 
 // Signal for a Scintilla notification.
 static void notified(SciObject *view, int _, SCNotification *n, void *__) {
+	if (n->nmhdr.code == SCN_MODIFIED && view != command_entry &&
+		(n->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+		count_edit(view);
 	if (n->nmhdr.code == SCN_STYLENEEDED) {
 		lua_pushdoc(lua, SS(view, SCI_GETDOCPOINTER, 0, 0));
 		emit("style_needed", LUA_TNUMBER, n->position + 1, LUA_TTABLE, luaL_ref(lua, LUA_REGISTRYINDEX),
@@ -1159,7 +2711,7 @@ static int view_index(lua_State *L) {
 	} else if (lua_getfield(L, LUA_REGISTRYINDEX, "ta_functions"), lua_pushvalue(L, 2),
 		lua_rawget(L, -2) == LUA_TTABLE)
 		// If the key is a Scintilla function, return a callable closure.
-		lua_pushcclosure(L, call_scintilla_lua, 1);
+		push_scintilla_function(L);
 	else if (lua_getfield(L, LUA_REGISTRYINDEX, "ta_properties"), lua_pushvalue(L, 2),
 		lua_rawget(L, -2) == LUA_TTABLE)
 		// If the key is a Scintilla property, determine if it is an indexible one or not. If so,
@@ -1233,12 +2785,14 @@ void close_textadept() {
 			lua_rawgeti(lua, -1, i), delete_buffer(lua_todoc(lua, -1)); // popped on loop
 		lua_pop(lua, 1); // buffers
 		delete_scintilla(focused_view), delete_scintilla(command_entry), delete_scintilla(dummy_view);
-		lua_close(lua), lua = NULL;
+		lua_close(lua), lua = NULL, free_pool();
 	}
+	free_watches();
 	if (textadept_home) free(textadept_home), textadept_home = NULL;
 }
 
 bool init_textadept(int argc, char **argv) {
+	clock_monotonic(); // start the clock
 	char *last_slash = NULL;
 	textadept_home = malloc(FILENAME_MAX + 1);
 #if __linux__
@@ -1260,15 +2814,23 @@ bool init_textadept(int argc, char **argv) {
 	if (getenv("TEXTADEPT_HOME")) strcpy(textadept_home, getenv("TEXTADEPT_HOME"));
 
 	setlocale(LC_COLLATE, "C"), setlocale(LC_NUMERIC, "C"); // for Lua
+	double start = clock_monotonic(); // also starts the clock
 	if (!init_lua(argc, argv)) return (close_textadept(), false); // exit_status has been set
+	if (profiling) profile(lua, "startup: Lua", start, true), start = clock_monotonic();
 	command_entry = new_scintilla(notified), add_doc(0), dummy_view = new_scintilla(notified);
-	SS(dummy_view, SCI_SETMODEVENTMASK, SC_MOD_NONE, 0);
-	initing = true, new_window(create_first_view), run_file("init.lua"), initing = false;
+	SS(dummy_view, SCI_SETMODEVENTMASK, SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT, 0); // count_edit()
+	initing = true, new_window(create_first_view);
+	if (profiling) profile(lua, "startup: window", start, true), start = clock_monotonic();
+	run_file("init.lua"), initing = false;
+	if (profiling) profile(lua, "startup: init.lua", start, true), start = clock_monotonic();
 	emit("buffer_new", -1), emit("view_new", -1); // first ones
 	lua_pushdoc(lua, SS(command_entry, SCI_GETDOCPOINTER, 0, 0)), lua_setglobal(lua, "buffer");
 	emit("buffer_new", -1), emit("view_new", -1); // command entry
 	lua_pushdoc(lua, SS(focused_view, SCI_GETDOCPOINTER, 0, 0)), lua_setglobal(lua, "buffer");
-	return (emit("initialized", -1), true); // ready
+	emit("initialized", -1);
+	if (profiling) profile(lua, "startup: initialized", start, true), profile(lua, "startup", 0, true);
+	if (batch) return (close_textadept(), false); // done; exit_status was set by quit()
+	return true; // ready
 }
 
 // Note: this function is entirely dependent on Lua to create `ui.context_menu` and
@@ -26,9 +26,12 @@ extern int exit_status;
  * startup scripts. Platforms should typically call this after their own initialization and
  * before starting the main event loop.
  * Any startup errors are presented in a dialog. Emits an 'initialized' event on success.
+ * In batch mode ('-B' or '--batch') and when running benchmarks ('-b' or '--bench'), Lua does
+ * all of its work while handling that event, so this closes Textadept afterwards and returns
+ * `false` with `exit_status` set.
  * @param argc The number of command line arguments.
  * @param argv List of command line argument strings.
- * @return whether or not initialization succeeded
+ * @return whether or not initialization succeeded and the main event loop should start
  */
 bool init_textadept(int argc, char **argv);
 
@@ -71,16 +74,88 @@ void show_context_menu(const char *name, void *userdata);
  */
 void mode_changed();
 
+/** The number of bytes of stdout or stderr Textadept buffers for a spawned child process
+ * before calling any functions listening for that output.
+ */
+#define PROCESS_OUTPUT_SIZE (64 * 1024)
+
 /** Notifies Textadept that a spawned child process has produced the given stdout or stderr.
- * Textadept will call any functions listening for that output.
+ * Textadept buffers that output and will call any functions listening for it when either its
+ * buffer fills up (with any complete lines of output) or the platform calls
+ * `flush_process_output()`. Platforms should read as much output as is available before
+ * flushing it.
+ * @return whether or not the platform may continue reading. `false` means the buffer filled
+ *	up, and the platform should stop reading for now (leaving any further output in the pipe)
+ *	and flush.
+ * @see flush_process_output
+ */
+bool process_output(Process *proc, const char *s, size_t len, bool is_stdout);
+
+/** Notifies Textadept that the platform has finished reading available output from a spawned
+ * child process.
+ * Textadept will call any functions listening for buffered output.
  */
-void process_output(Process *proc, const char *s, size_t len, bool is_stdout);
+void flush_process_output(Process *proc);
 
 /** Notifies Textadept that a spawned child process has exited with the given exit code.
- * Textadept will call an exit function (if it exists) for that process.
+ * Textadept will flush any buffered output and then call an exit function (if it exists)
+ * for that process.
  */
 void process_exited(Process *proc, int code);
 
+/** Notifies Textadept that the platform has read the given input from stdin, or that stdin was
+ * closed if *len* is 0.
+ * Textadept will call the function listening for that input.
+ * @see watch_stdin
+ */
+void stdin_input(const char *s, size_t len);
+
+/** Notifies Textadept that file change notices are available on the descriptor given to
+ * `watch_changes()`.
+ * Textadept will read them without blocking, and report them once their burst ends.
+ * @see watch_changes
+ */
+void file_changes_ready();
+
+/** Contains the state of a list dialog's filter.
+ * Platforms initialize one with `init_list_filter()`, call `filter_list()` whenever the search
+ * key changes, and display only the rows in *matches*.
+ */
+typedef struct {
+	const char **items; // the search column's item for each row
+	int num_rows, num_matches;
+	int *matches; // 0-based indices of rows that match the current search key, in order
+	char *key; // the current search key
+} ListFilter;
+
+/** Returns whether or not the given list item matches the given list dialog search key.
+ * Each space-separated word in the key must match the item, case-insensitively and
+ * sequentially. Non-ASCII UTF-8 characters are compared using the current locale's case mapping.
+ * @param item The list item to match.
+ * @param key The search key to match against.
+ * @return whether or not the item matches
+ */
+bool list_item_matches(const char *item, const char *key);
+
+/** Initializes the given list filter with the given items, all of which initially match.
+ * Textadept does not copy the items, so they must outlive the filter.
+ * @param filter The list filter to initialize.
+ * @param items The search column's item for each row.
+ * @param num_rows The number of rows.
+ */
+void init_list_filter(ListFilter *filter, const char **items, int num_rows);
+
+/** Updates the given list filter's matches for the given search key.
+ * If the key only appends to the previous key, only the previous matches are searched. Large
+ * lists are searched in parallel.
+ * @param filter The list filter to update.
+ * @param key The new search key.
+ */
+void filter_list(ListFilter *filter, const char *key);
+
+/** Frees the memory used by the given list filter, but not its items. */
+void free_list_filter(ListFilter *filter);
+
 /** Closes Textadept.
  * Unsplits panes, closes buffers, deletes Scintilla views, and closes Lua. During this process,
  * Textadept may still call `SS()`, so platforms should take care to call this while Scintilla
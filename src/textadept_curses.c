@@ -8,11 +8,15 @@
 #include "termkey.h"
 
 #include <locale.h>
-#include <math.h> // for fmax
+#include <math.h> // for ceil, fmax
 #if !_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/wait.h>
+#include <time.h> // for clock_gettime
 #else
 #include <windows.h>
 #include <direct.h>
@@ -412,91 +416,217 @@ struct Process {
 static inline struct Process *PROCESS(struct Process *proc) { return proc; }
 
 #if !_WIN32
-// Pushes the list of spawned processes onto the stack.
-void lua_getspawnedprocesses(lua_State *L) {
-	if (!lua_getfield(L, LUA_REGISTRYINDEX, "spawn_procs"))
-		lua_newtable(L), lua_pushvalue(L, -1), lua_setfield(L, LUA_REGISTRYINDEX, "spawn_procs");
-}
-
-// Creates and returns an `fd_set` for all spawned processes that can be used with `select()`
-// and `read_fds()` to wait for input or output.
-// The caller is expected to free the returned pointer.
-fd_set *new_fds(int *nfds) {
-	*nfds = 0;
-	fd_set *fds = malloc(sizeof(fd_set));
-	FD_ZERO(fds); // TODO: is calloc enough?
-	lua_getspawnedprocesses(lua);
-	for (lua_pushnil(lua); lua_next(lua, -2); lua_pop(lua, 1)) {
-		struct Process *proc = lua_touserdata(lua, -2);
-		// Note: need to read from pipes so they do not get clogged, even if monitoring is not
-		// requested.
-		FD_SET(proc->fstdout, fds); // note: this is a do/while macro on OSX
-		*nfds = fmax(*nfds, proc->fstdout + 1);
-		FD_SET(proc->fstderr, fds); // note: this is a do/while macro on OSX
-		*nfds = fmax(*nfds, proc->fstderr + 1);
+// Spawned processes being monitored and the file descriptors to poll for them. The first three
+// file descriptors are stdin, the read end of the SIGCHLD pipe, and the file change notice
+// descriptor from `watch_changes()`, followed by the stdout and stderr of each process in
+// `procs`, in order.
+static struct Process **procs;
+static struct pollfd *pollfds;
+static int nprocs, maxprocs;
+static int changes_fd = -1;
+static int sigchld_pipe[2] = {-1, -1};
+static volatile sig_atomic_t sigchld;
+
+// Signal that a child process finished.
+// Writing to a pipe wakes up poll() so that finished processes are only checked for when needed.
+static void child_signalled(int _) {
+	int saved_errno = errno;
+	sigchld = true, write(sigchld_pipe[1], "", 1), errno = saved_errno;
+}
+
+// Sets up the SIGCHLD handler if it has not been already.
+// This must happen before forking so that children that finish right away are not missed.
+static void init_sigchld() {
+	if (sigchld_pipe[0] >= 0 || pipe(sigchld_pipe) < 0) return;
+	for (int i = 0; i < 2; i++)
+		fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK), fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+	struct sigaction act;
+	memset(&act, 0, sizeof(struct sigaction));
+	act.sa_handler = child_signalled, act.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &act, NULL);
+}
+
+// Starts monitoring the given process.
+static void add_proc(struct Process *proc) {
+	if (nprocs == maxprocs) {
+		maxprocs = maxprocs ? maxprocs * 2 : 4;
+		procs = realloc(procs, maxprocs * sizeof(struct Process *));
+		pollfds = realloc(pollfds, (3 + 2 * maxprocs) * sizeof(struct pollfd));
+	}
+	// Note: need to read from pipes so they do not get clogged, even if monitoring is not
+	// requested.
+	procs[nprocs] = proc;
+	pollfds[3 + 2 * nprocs] = (struct pollfd){proc->fstdout, POLLIN, 0};
+	pollfds[4 + 2 * nprocs] = (struct pollfd){proc->fstderr, POLLIN, 0};
+	nprocs++;
+}
+
+// Stops monitoring the given process.
+static void remove_proc(struct Process *proc) {
+	for (int i = 0; i < nprocs; i++) {
+		if (procs[i] != proc) continue;
+		nprocs--, procs[i] = procs[nprocs]; // move the last process into this slot
+		pollfds[3 + 2 * i] = pollfds[3 + 2 * nprocs], pollfds[4 + 2 * i] = pollfds[4 + 2 * nprocs];
+		break;
 	}
-	return (lua_pop(lua, 1), fds); // spawned processes
 }
 
 // Signal that a process has output to read.
-static void read_proc(struct Process *proc, bool is_stdout) {
+// Returns whether or not reading stopped early because Textadept's output buffer filled up. If
+// so, the rest of the output is read on the next call, and until then the process blocks when
+// the pipe fills up.
+static bool read_proc(struct Process *proc, bool is_stdout) {
 	char buf[BUFSIZ];
 	ssize_t len;
+	// Note: need to read from pipes to prevent clogging, but only report output if monitoring.
+	bool monitoring = is_stdout ? proc->monitor_stdout : proc->monitor_stderr, more = true;
 	do {
-		// Note: need to read from pipes to prevent clogging, but only report output if monitoring.
-		bool monitoring = is_stdout ? proc->monitor_stdout : proc->monitor_stderr;
 		if ((len = read(is_stdout ? proc->fstdout : proc->fstderr, buf, BUFSIZ)) > 0 && monitoring)
-			process_output(proc, buf, len, is_stdout);
-	} while (len == BUFSIZ);
+			more = process_output(proc, buf, len, is_stdout);
+	} while (len == BUFSIZ && more);
+	if (monitoring) flush_process_output(proc);
+	return !more;
 }
 
 // Cleans up after the process finished executing and returned the given status code.
 static void process_finished(struct Process *proc, int status) {
-	// Stop tracking and monitoring this proc.
-	lua_getspawnedprocesses(lua);
-	for (lua_pushnil(lua); lua_next(lua, -2); lua_pop(lua, 1))
-		if (((struct Process *)lua_touserdata(lua, -2))->pid == proc->pid) {
-			lua_pushnil(lua), lua_replace(lua, -2), lua_settable(lua, -3); // t[proc] = nil
-			break;
-		}
-	lua_pop(lua, 1); // spawned processes
+	remove_proc(proc); // stop monitoring this proc
 	proc->pid = 0, close(proc->fstdin), close(proc->fstdout), close(proc->fstderr);
 	process_exited(proc, proc->exit_status = status);
 }
+#endif
 
-// Reads output from the given fd_set and returns the number of fds read from.
-// Also monitors child processes for completion and cleans up after them.
-int read_fds(fd_set *fds) {
-	int n = 0;
-	lua_getspawnedprocesses(lua);
-	for (lua_pushnil(lua); lua_next(lua, -2); lua_pop(lua, 1)) {
-		struct Process *proc = lua_touserdata(lua, -2);
-		// Read output if any is available.
-		if (FD_ISSET(proc->fstdout, fds)) read_proc(proc, true), n++;
-		if (FD_ISSET(proc->fstderr, fds)) read_proc(proc, false), n++;
-		// Check process status. If finished, read anything left and cleanup.
-		int status;
-		if (waitpid(proc->pid, &status, WNOHANG) > 0) {
-			read_proc(proc, true), read_proc(proc, false), process_finished(proc, status);
-			lua_pushnil(lua), lua_replace(lua, -3); // key no longer exists
-		}
+char *get_clipboard_text(int *len) { return scintilla_get_clipboard(focused_view, len); }
+
+#if !_WIN32
+// Contains information about a pending timeout.
+typedef struct {
+	double time, interval; // time is when the timeout is next due
+	bool (*f)(int *);
+	int *refs;
+} Timeout;
+static Timeout *timeouts; // binary min-heap ordered by due time
+static int ntimeouts, maxtimeouts;
+
+// Returns the current monotonic time in seconds.
+static double now() {
+	struct timespec ts;
+	return (clock_gettime(CLOCK_MONOTONIC, &ts), ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+// Adds the given timeout to the timeout heap.
+static void push_timeout(Timeout timeout) {
+	if (ntimeouts == maxtimeouts)
+		maxtimeouts = maxtimeouts ? maxtimeouts * 2 : 8,
+		timeouts = realloc(timeouts, maxtimeouts * sizeof(Timeout));
+	int i = ntimeouts++;
+	for (; i > 0 && timeouts[(i - 1) / 2].time > timeout.time; i = (i - 1) / 2)
+		timeouts[i] = timeouts[(i - 1) / 2]; // sift up
+	timeouts[i] = timeout;
+}
+
+// Removes and returns the next due timeout from the timeout heap.
+static Timeout pop_timeout() {
+	Timeout timeout = timeouts[0], last = timeouts[--ntimeouts];
+	int i = 0;
+	for (int child; (child = 2 * i + 1) < ntimeouts; i = child) {
+		if (child + 1 < ntimeouts && timeouts[child + 1].time < timeouts[child].time) child++;
+		if (timeouts[child].time >= last.time) break;
+		timeouts[i] = timeouts[child]; // sift down
 	}
-	return (lua_pop(lua, 1), n); // spawned processes
+	if (ntimeouts > 0) timeouts[i] = last;
+	return timeout;
 }
-#endif
 
-char *get_clipboard_text(int *len) { return scintilla_get_clipboard(focused_view, len); }
+bool add_timeout(double interval, bool (*f)(int *), int *refs) {
+	return (push_timeout((Timeout){now() + interval, interval, f, refs}), true);
+}
+
+// Calls any timeout functions that are due, rescheduling the ones that should repeat, and
+// returns whether or not any were called.
+static bool call_timeouts() {
+	double time = now();
+	bool called = false;
+	while (ntimeouts > 0 && timeouts[0].time <= time) {
+		Timeout timeout = pop_timeout(); // note: the function may add more timeouts
+		called = true;
+		if (!timeout.f(timeout.refs)) continue;
+		timeout.time = fmax(timeout.time + timeout.interval, time), push_timeout(timeout);
+	}
+	return called;
+}
+
+// Returns the number of milliseconds until the next timeout is due, capped by the given number
+// of milliseconds (-1 for no cap).
+static int next_timeout(int max) {
+	if (ntimeouts == 0) return max;
+	int ms = fmax(ceil((timeouts[0].time - now()) * 1000), 0);
+	return max < 0 || ms < max ? ms : max;
+}
 
+// Waits up to the given number of milliseconds (-1 to wait indefinitely) for process output,
+// finished processes, file change notices, stdin input (if *stdin_ready* is non-NULL), or the
+// next timeout, and handles process output, finished processes, and file change notices.
+// Stdin input is only reported, and due timeouts are left for `call_timeouts()`.
+// Returns whether or not any process output or finished processes were handled.
+static bool poll_events(int timeout, bool *stdin_ready) {
+	if (!pollfds) pollfds = calloc(3, sizeof(struct pollfd));
+	pollfds[0] = (struct pollfd){stdin_ready ? 0 : -1, POLLIN, 0}; // negative fds are ignored
+	pollfds[1] = (struct pollfd){sigchld_pipe[0], POLLIN, 0};
+	pollfds[2] = (struct pollfd){changes_fd, POLLIN, 0};
+	if (poll(pollfds, 3 + 2 * nprocs, next_timeout(timeout)) > 0 && stdin_ready)
+		*stdin_ready = pollfds[0].revents;
+	if (pollfds[2].revents) file_changes_ready(); // only reads them; a timeout reports them
+	bool handled = false;
+	// Read output if any is available. Iterate in reverse since finished processes are removed,
+	// and clear events after handling them in case callbacks cause processes to move.
+	for (int i = nprocs - 1; i >= 0; i--) {
+		for (int j = 0; j < 2 && i < nprocs; j++) {
+			struct pollfd *pfd = &pollfds[3 + 2 * i + j];
+			int revents = pfd->revents;
+			if (!revents) continue;
+			// Stop polling a closed pipe so it does not keep waking poll() up.
+			if (pfd->revents = 0, !(revents & POLLIN)) pfd->fd = -1;
+			read_proc(procs[i], j == 0), handled = true;
+		}
+	}
+	// Check process statuses only after a child process finished. If one finished, read
+	// anything left and cleanup.
+	if (!sigchld) return handled;
+	char buf[64];
+	sigchld = false; // note: reset before draining so that signals are never missed
+	while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0) {}
+	for (int i = nprocs - 1; i >= 0; i--) {
+		if (i >= nprocs) continue; // a callback caused more than one process to finish
+		struct Process *proc = procs[i];
+		int status;
+		if (waitpid(proc->pid, &status, WNOHANG) <= 0) continue;
+		while (read_proc(proc, true)) {}
+		while (read_proc(proc, false)) {}
+		process_finished(proc, status), handled = true;
+	}
+	return handled;
+}
+#else
 bool add_timeout(double interval, bool (*f)(int *), int *refs) { return false; }
+#endif
 
 void update_ui() {
 #if !_WIN32
-	struct timeval timeout = {0, 1e5}; // 0.1s
-	int nfds;
-	fd_set *fds = new_fds(&nfds);
-	while (select(nfds, fds, NULL, NULL, &timeout) > 0)
-		if (read_fds(fds) >= 0) refresh_all();
-	free(fds);
+	// Handle process events for up to 0.1s, but do not keep going for timeouts, since a repeating
+	// one would keep this from ever returning.
+	double end = now() + 0.1;
+	while (now() < end && poll_events(fmax(ceil((end - now()) * 1000), 0), NULL)) refresh_all();
+	if (call_timeouts()) refresh_all();
+#endif
+}
+
+void wait_ui() {
+#if !_WIN32
+	bool handled = poll_events(-1, NULL);
+	if (call_timeouts() || handled) refresh_all();
+#else
+	update_ui();
 #endif
 }
 
@@ -646,40 +776,19 @@ static int scroll_keypress(EObjectType _, void *__, void *data, chtype key) {
 
 // Contains information about a list view.
 typedef struct {
-	int num_columns, search_column, num_items;
-	char **items, **rows, **filtered_rows;
+	char **rows, **filtered_rows;
+	ListFilter filter;
 	CDKSCROLL *scroll;
 } ListData;
 
 // Shows and hides a list's item/row depending on the current search key.
-// Iterates over all space-separated words in the key, matching each word to the item/row
-// case-insensitively  and sequentially. If all key words match, shows the item/row.
 static int refilter(EObjectType _, void *entry, void *data, chtype __) {
-	char *key = getCDKEntryValue((CDKENTRY *)entry);
 	ListData *list_data = data;
-	if (*key) {
-		int row = 0;
-		for (int i = 0; i < list_data->num_items; i += list_data->num_columns) {
-			char *item = list_data->items[i + list_data->search_column - 1];
-			bool visible = false;
-			const char *match_pos = item;
-			for (const char *s = key, *e = s;; s = e) {
-				while (*e && *e != ' ') e++;
-				bool match = false;
-				for (const char *p = match_pos; *p; p++)
-					if (strncasecmp(s, p, e - s) == 0) {
-						match_pos = p + (e - s), match = true;
-						break;
-					}
-				if (match && !*e) visible = true;
-				if (!match || !*e++) break;
-			}
-			if (visible) list_data->filtered_rows[row++] = list_data->rows[i / list_data->num_columns];
-		}
-		setCDKScrollItems(list_data->scroll, list_data->filtered_rows, row, false);
-	} else
-		setCDKScrollItems(
-			list_data->scroll, list_data->rows, list_data->num_items / list_data->num_columns, false);
+	ListFilter *filter = &list_data->filter;
+	filter_list(filter, getCDKEntryValue((CDKENTRY *)entry));
+	for (int i = 0; i < filter->num_matches; i++)
+		list_data->filtered_rows[i] = list_data->rows[filter->matches[i]];
+	setCDKScrollItems(list_data->scroll, list_data->filtered_rows, filter->num_matches, false);
 	HasFocusObj(ObjOf(list_data->scroll)) = true; // needed to draw highlight
 	eraseCDKScroll(list_data->scroll); // drawCDKScroll does not completely redraw
 	drawCDKScroll(list_data->scroll, true), drawCDKEntry((CDKENTRY *)entry, false);
@@ -761,23 +870,23 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 		bindCDKObject(vENTRY, entry, KEY_PPAGE, scroll_keypress, scroll),
 		bindCDKObject(vENTRY, entry, KEY_NPAGE, scroll_keypress, scroll);
 	// TODO: commands to scroll the list to the right and left.
-	ListData data = {
-		num_columns, opts.search_column, num_items, items, &rows[1], filtered_rows, scroll};
+	ListData data = {&rows[1], filtered_rows, {0}, scroll};
+	const char **search_items = malloc((num_rows > 0 ? num_rows : 1) * sizeof(char *));
+	for (int i = 0; i < num_rows; i++)
+		search_items[i] = i * num_columns + opts.search_column - 1 < num_items ?
+			items[i * num_columns + opts.search_column - 1] :
+			"";
+	init_list_filter(&data.filter, search_items, num_rows);
 	setCDKEntryPostProcess(entry, refilter, &data);
 	if (opts.text) setCDKEntryValue(entry, (char *)opts.text);
 
 	draw_dialog(&dialog), refilter(vENTRY, entry, &data, 0), activateCDKEntry(entry, NULL);
 	// Note: buttons are right-to-left.
 	int button = (entry->exitType == vNORMAL) ? box->buttonCount - box->currentButton : 0;
-	int index = getCDKScrollItems(scroll, NULL) > 0 ? getCDKScrollCurrentItem(scroll) + 1 : 0;
-	if (index) {
-		char *item = filtered_rows[index - 1];
-		for (int j = 1; j < num_rows + 1; j++) // account for and skip header
-			if (strcmp(item, rows[j]) == 0) {
-				index = j; // non-filtered index of selected item (no +1 due to skipped header)
-				break;
-			}
-	}
+	int index = getCDKScrollItems(scroll, NULL) > 0 ?
+		data.filter.matches[getCDKScrollCurrentItem(scroll)] + 1 :
+		0;
+	free_list_filter(&data.filter), free(search_items);
 	// Note: table will be replaced by a single result if multiple is false.
 	lua_createtable(L, 0, 1), lua_pushinteger(L, index), lua_rawseti(L, -2, 1);
 	if (!opts.multiple) lua_rawgeti(L, -1, 1), lua_replace(L, -2); // single result
@@ -824,6 +933,7 @@ bool spawn(lua_State *L, Process *proc, int index, const char *cmd, const char *
 
 	// Adapted from Chris Emerson and GLib.
 	// Attempt to create pipes for stdin, stdout, and stderr and fork process.
+	init_sigchld();
 	int pstdin[2] = {-1, -1}, pstdout[2] = {-1, -1}, pstderr[2] = {-1, -1}, pid = -1;
 	if (pipe(pstdin) == 0 && pipe(pstdout) == 0 && pipe(pstderr) == 0 && (pid = fork()) < 0) {
 		if (pstdin[0] >= 0) close(pstdin[0]), close(pstdin[1]);
@@ -837,9 +947,7 @@ bool spawn(lua_State *L, Process *proc, int index, const char *cmd, const char *
 		struct Process *p = proc;
 		p->pid = pid, p->fstdin = pstdin[1], p->fstdout = pstdout[0], p->fstderr = pstderr[0],
 		p->monitor_stdout = monitor_stdout, p->monitor_stderr = monitor_stderr;
-		lua_checkstack(L, 3), lua_getspawnedprocesses(lua), lua_pushvalue(L, index),
-			lua_pushboolean(L, 1), lua_settable(L, -3); // t[proc] = true
-		return true;
+		return (add_proc(p), true);
 	}
 	// Child process: redirect stdin, stdout, and stderr, chdir, and exec.
 	close(pstdin[1]), close(pstdout[0]), close(pstderr[0]), close(0), close(1), close(2);
@@ -921,6 +1029,16 @@ int get_process_exit_status(Process *proc) { return PROCESS(proc)->exit_status;
 
 void cleanup_process(Process *proc) {}
 
+bool watch_stdin() { return false; } // stdin is the terminal
+
+bool watch_changes(int fd) {
+#if !_WIN32
+	return (changes_fd = fd, fd != -1);
+#else
+	return false;
+#endif
+}
+
 void suspend() {
 #if !_WIN32
 	emit("suspend", -1), endwin(), termkey_stop(ta_tk), kill(0, SIGSTOP);
@@ -948,21 +1066,16 @@ static TermKeyResult textadept_waitkey(TermKey *tk, TermKeyKey *key) {
 	refresh_all();
 #if !_WIN32
 	bool force = false;
-	struct timeval timeout = {0, termkey_get_waittime(tk)};
+	int timeout = termkey_get_waittime(tk); // milliseconds, like poll()
 	while (true) {
 		TermKeyResult res = !force ? termkey_getkey(tk, key) : termkey_getkey_force(tk, key);
 		if (res != TERMKEY_RES_AGAIN && res != TERMKEY_RES_NONE) return res;
 		if (res == TERMKEY_RES_AGAIN) force = true;
-		// Wait for input.
-		int nfds;
-		fd_set *fds = new_fds(&nfds);
-		FD_SET(0, fds); // monitor stdin (note: this is a do/while macro on OSX)
-		nfds = fmax(nfds, 1);
-		if (select(nfds, fds, NULL, NULL, force ? &timeout : NULL) > 0) {
-			if (FD_ISSET(0, fds)) termkey_advisereadable(tk);
-			if (read_fds(fds) > 0) refresh_all();
-		}
-		free(fds);
+		// Wait for input, process output, or timeouts.
+		bool stdin_ready = false;
+		bool handled = poll_events(force ? timeout : -1, &stdin_ready);
+		if (call_timeouts() || handled) refresh_all();
+		if (stdin_ready) termkey_advisereadable(tk);
 	}
 #else
 	// TODO: ideally computation of view would not be done twice.
@@ -976,15 +1089,28 @@ static TermKeyResult textadept_waitkey(TermKey *tk, TermKeyKey *key) {
 // Runs Textadept.
 int main(int argc, char **argv) {
 	int termkey_flags = 0; // TERMKEY_FLAG_CTRLC does not work; SIGINT is patched out
+	bool batch = false;
 	for (int i = 0; i < argc; i++)
-		if (strcmp("-p", argv[i]) == 0 || strcmp("--preserve", argv[i]) == 0) {
+		if (strcmp("-p", argv[i]) == 0 || strcmp("--preserve", argv[i]) == 0)
 			termkey_flags |= TERMKEY_FLAG_FLOWCONTROL;
-			break;
-		} else if ((strcmp("-L", argv[i]) == 0 || strcmp("--lua", argv[i]) == 0) && i + 1 < argc)
+		else if ((strcmp("-L", argv[i]) == 0 || strcmp("--lua", argv[i]) == 0) && i + 1 < argc)
 			return (init_textadept(argc, argv), exit_status); // avoid curses init
-	ta_tk = termkey_new(0, termkey_flags);
+		else if (strcmp("-B", argv[i]) == 0 || strcmp("--batch", argv[i]) == 0 ||
+			strcmp("-b", argv[i]) == 0 || strcmp("--bench", argv[i]) == 0)
+			batch = true;
 	setlocale(LC_CTYPE, ""); // for displaying UTF-8 characters properly
-	initscr(); // raw()/cbreak() and noecho() are taken care of in libtermkey
+	if (!batch) {
+		ta_tk = termkey_new(0, termkey_flags);
+		initscr(); // raw()/cbreak() and noecho() are taken care of in libtermkey
+	} else {
+		// Run headless by drawing to a null device instead of the terminal, which may not exist.
+#if !_WIN32
+		const char *null_device = "/dev/null";
+#else
+		const char *null_device = "NUL";
+#endif
+		newterm("vt100", fopen(null_device, "w"), fopen(null_device, "r"));
+	}
 #if NCURSES_REENTRANT
 	ESCDELAY = getenv("ESCDELAY") ? atoi(getenv("ESCDELAY")) : 100;
 #endif
@@ -992,7 +1118,8 @@ int main(int argc, char **argv) {
 	replace_all = &button_labels[3], match_case = &find_options[0], whole_word = &find_options[1],
 	regex = &find_options[2], in_files = &find_options[3]; // typedefed, so cannot static initialize
 
-	if (!init_textadept(argc, argv)) return (endwin(), termkey_destroy(ta_tk), exit_status);
+	if (!init_textadept(argc, argv))
+		return (endwin(), ta_tk ? termkey_destroy(ta_tk) : (void)0, exit_status);
 
 #if !_WIN32
 	freopen("/dev/null", "w", stderr); // redirect stderr
@@ -1012,7 +1139,8 @@ int main(int argc, char **argv) {
 	// clang-format off
   int keysyms[] = {0,SCK_BACK,SCK_TAB,SCK_RETURN,SCK_ESCAPE,0,SCK_BACK,SCK_UP,SCK_DOWN,SCK_LEFT,SCK_RIGHT,0,0,SCK_INSERT,SCK_DELETE,0,SCK_PRIOR,SCK_NEXT,SCK_HOME,SCK_END};
 	// clang-format on
-	while ((ch = 0, res = textadept_waitkey(ta_tk, &key)) != TERMKEY_RES_EOF) {
+	// Note: check for quitting first in case an `events.INITIALIZED` handler quit (e.g. benchmarks).
+	while (!quitting && (ch = 0, res = textadept_waitkey(ta_tk, &key)) != TERMKEY_RES_EOF) {
 		if (res == TERMKEY_RES_ERROR) continue;
 		if (key.type == TERMKEY_TYPE_UNICODE)
 			ch = key.code.codepoint;
@@ -1056,5 +1184,5 @@ int main(int argc, char **argv) {
 		if (repl_history[i]) free(repl_history[i]);
 		if (i < 4) free(button_labels[i]), free(option_labels[i] - (find_options[i] ? 0 : 4));
 	}
-	return 0;
+	return exit_status;
 }
@@ -6,8 +6,10 @@
 #include "lauxlib.h"
 
 #include <math.h> // for fmax
+#include <fcntl.h> // for fcntl
 #include <signal.h>
 #include <sys/wait.h>
+#include <unistd.h> // for isatty
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
 #include "ScintillaWidget.h" // must come after <gtk/gtk.h>
@@ -505,6 +507,8 @@ void update_ui() {
 	while (gtk_events_pending()) gtk_main_iteration();
 }
 
+void wait_ui() { gtk_main_iteration_do(true); }
+
 bool is_dark_mode() {
 #if GTK_CHECK_VERSION(3, 0, 0)
 	GtkStyleContext *context = gtk_style_context_new();
@@ -618,30 +622,29 @@ int progress_dialog(
 }
 
 // Function for comparing the given search key with a list's item/row.
-// Iterates over all space-separated words in the key, matching each word to the item/row
-// case-insensitively  and sequentially. If all key words match, returns 0 on success, like strcmp.
+// Returns 0 if the item/row matches, like strcmp.
 static int matches(GtkTreeModel *model, int column, const char *key, GtkTreeIter *iter, void *_) {
-	if (!*key) return 0; // true
 	char *item;
 	gtk_tree_model_get(model, iter, column, &item, -1);
-	const char *match_pos = item;
-	for (const char *s = key, *e = s;; s = e) {
-		while (*e && *e != ' ') e++;
-		bool match = false;
-		for (const char *p = match_pos; *p; p++)
-			if (g_strncasecmp(s, p, e - s) == 0) {
-				match_pos = p + (e - s), match = true;
-				break;
-			}
-		if (!match || !*e++) return (free(item), !match); // !match is false, !*e is true (like strcmp)
-	}
+	bool match = list_item_matches(item, key);
+	return (free(item), !match);
 }
 
+// Contains information about a list view.
+typedef struct {
+	GtkTreeView *treeview;
+	ListFilter filter;
+	bool *visible; // whether or not each row matches the current search key
+	int index_column; // the hidden column that contains each row's index
+} ListData;
+
 // Function for determining whether a list's item/row should be shown.
 // A list item/row should only be shown if it matches the current search key.
-static int visible(GtkTreeModel *model, GtkTreeIter *iter, void *treeview) {
-	const char *key = gtk_entry_get_text(gtk_tree_view_get_search_entry(treeview));
-	return matches(model, gtk_tree_view_get_search_column(treeview), key, iter, NULL) == 0;
+static int visible(GtkTreeModel *model, GtkTreeIter *iter, void *data) {
+	ListData *list_data = data;
+	int index;
+	gtk_tree_model_get(model, iter, list_data->index_column, &index, -1);
+	return list_data->visible[index];
 }
 
 // Selects the first item in the given view if an item is not already selected.
@@ -656,7 +659,13 @@ static void select_first_item(GtkTreeView *view) {
 }
 
 // Signal for showing and hiding list values/rows depending on the current search key.
-static void refilter(GtkEditable *_, void *view) {
+static void refilter(GtkEditable *entry, void *data) {
+	ListData *list_data = data;
+	ListFilter *filter = &list_data->filter;
+	filter_list(filter, gtk_entry_get_text(GTK_ENTRY(entry)));
+	memset(list_data->visible, 0, filter->num_rows * sizeof(bool));
+	for (int i = 0; i < filter->num_matches; i++) list_data->visible[filter->matches[i]] = true;
+	GtkTreeView *view = list_data->treeview;
 	gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(gtk_tree_view_get_model(view))),
 		select_first_item(view);
 }
@@ -700,16 +709,25 @@ static void add_selected_row(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter
 int list_dialog(DialogOptions opts, lua_State *L) {
 	int num_columns = opts.columns ? lua_rawlen(L, opts.columns) : 1,
 			num_items = lua_rawlen(L, opts.items);
-	GType cols[num_columns];
+	// Store each row's index in a hidden column for quickly looking up whether it is visible.
+	GType cols[num_columns + 1];
 	for (int i = 0; i < num_columns; i++) cols[i] = G_TYPE_STRING;
-	GtkListStore *store = gtk_list_store_newv(num_columns, cols);
+	cols[num_columns] = G_TYPE_INT;
+	GtkListStore *store = gtk_list_store_newv(num_columns + 1, cols);
+	int num_rows = (num_items + num_columns - 1) / num_columns; // account for non-full rows
+	const char **search_items = malloc((num_rows > 0 ? num_rows : 1) * sizeof(char *));
 	for (int i = 1, j = 0; i <= num_items; i++) {
 		GtkTreeIter iter;
-		if (j == 0) gtk_list_store_append(store, &iter);
+		int row = (i - 1) / num_columns;
+		if (j == 0) gtk_list_store_append(store, &iter), search_items[row] = "";
 		const char *item = (lua_rawgeti(L, opts.items, i), lua_tostring(L, -1));
-		gtk_list_store_set(store, &iter, j++, item, -1), lua_pop(L, 1);
+		gtk_list_store_set(store, &iter, j, item, num_columns, row, -1), lua_pop(L, 1);
+		if (j++ == opts.search_column - 1) search_items[row] = item; // owned by opts.items
 		if (j == num_columns) j = 0; // new row
 	}
+	ListData data = {NULL, {0}, calloc(num_rows > 0 ? num_rows : 1, sizeof(bool)), num_columns};
+	init_list_filter(&data.filter, search_items, num_rows);
+	for (int i = 0; i < num_rows; i++) data.visible[i] = true;
 	GtkTreeModel *filter = gtk_tree_model_filter_new(GTK_TREE_MODEL(store), NULL);
 
 	GtkWidget *dialog = new_dialog(&opts), *entry = gtk_entry_new(),
@@ -721,7 +739,8 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
 	gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(dlg)), scrolled, true, true, 0);
 	gtk_container_add(GTK_CONTAINER(scrolled), treeview);
-	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(filter), visible, treeview, NULL);
+	data.treeview = GTK_TREE_VIEW(treeview);
+	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(filter), visible, &data, NULL);
 	for (int i = 1; i <= num_columns; i++) {
 		const char *header = opts.columns ? (lua_rawgeti(L, opts.columns, i), lua_tostring(L, -1)) : "";
 		GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(
@@ -734,7 +753,7 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	gtk_tree_view_set_search_column(GTK_TREE_VIEW(treeview), opts.search_column - 1);
 	gtk_tree_view_set_search_entry(GTK_TREE_VIEW(treeview), GTK_ENTRY(entry));
 	gtk_tree_view_set_search_equal_func(GTK_TREE_VIEW(treeview), matches, NULL, NULL);
-	g_signal_connect(entry, "changed", G_CALLBACK(refilter), treeview);
+	g_signal_connect(entry, "changed", G_CALLBACK(refilter), &data);
 	g_signal_connect(entry, "key-release-event", G_CALLBACK(entry_keypress), treeview);
 	g_signal_connect(treeview, "key-press-event", G_CALLBACK(list_keypress), dialog);
 	g_signal_connect(treeview, "row-activated", G_CALLBACK(row_activated), dialog);
@@ -757,47 +776,65 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	gtk_window_move(GTK_WINDOW(dialog), x + (w - dw) / 2, y + (h - dh) / 2); // re-center
 
 	int button = (gtk_widget_show_all(dialog), gtk_dialog_run(dlg));
+	free_list_filter(&data.filter), free(search_items);
 	bool cancelled = button < 1 || (button == 2 && !opts.return_button);
 	if (cancelled || !gtk_tree_selection_count_selected_rows(selection))
-		return (gtk_widget_destroy(dialog), 0);
+		return (gtk_widget_destroy(dialog), free(data.visible), 0);
 	lua_newtable(L); // note: will be replaced by a single result if opts.multiple is false
 	gtk_tree_selection_selected_foreach(selection, add_selected_row, NULL);
 	if (!opts.multiple) lua_rawgeti(L, -1, 1), lua_replace(L, -2); // single result
 	if (opts.return_button) lua_pushinteger(L, button);
-	return (gtk_widget_destroy(dialog), !opts.return_button ? 1 : 2);
+	return (gtk_widget_destroy(dialog), free(data.visible), !opts.return_button ? 1 : 2);
 }
 
 // Contains information about an active process.
 struct Process {
 	int pid, fstdin, fstdout, fstderr, exit_status;
 	GIOChannel *cstdout, *cstderr;
+	bool monitor_stdout, monitor_stderr;
 };
 static inline struct Process *PROCESS(struct Process *proc) { return proc; }
 
-// Signal that channel output is available for reading.
-static int read_channel(GIOChannel *source, GIOCondition cond, void *proc) {
-	if (!PROCESS(proc)->pid || !(cond & G_IO_IN)) return false;
+// Reads available output from the given channel of the given process and returns whether or
+// not reading stopped early because Textadept's output buffer filled up.
+static bool read_output(GIOChannel *source, struct Process *proc) {
 	char buf[BUFSIZ];
 	size_t len = 0;
+	bool more = true;
 	do {
 		if (g_io_channel_read_chars(source, buf, BUFSIZ, &len, NULL) == G_IO_STATUS_NORMAL && len > 0)
-			process_output(PROCESS(proc), buf, len, source == PROCESS(proc)->cstdout);
-	} while (len == BUFSIZ);
+			more = process_output(proc, buf, len, source == proc->cstdout);
+	} while (len == BUFSIZ && more);
+	return (flush_process_output(proc), !more);
+}
+
+// Signal that channel output is available for reading.
+static int read_channel(GIOChannel *source, GIOCondition cond, void *proc) {
+	if (!PROCESS(proc)->pid || !(cond & G_IO_IN)) return false;
+	// Note: if reading stopped early, the rest of the output is read on the next main loop
+	// iteration. Until then, the process blocks when the pipe fills up.
+	read_output(source, proc);
 	return PROCESS(proc)->pid && !(cond & G_IO_HUP);
 }
 
 // Creates and returns a new channel for reading from the given file descriptor. The channel
 // can optionally monitor that file descriptor for output.
+// The process keeps its own reference to the channel, since a watch releases its reference
+// once it stops (e.g. on hang up), and the channel is still read after the process finishes.
 static GIOChannel *new_channel(int fd, Process *proc, bool watch) {
 	GIOChannel *channel = g_io_channel_unix_new(fd);
 	g_io_channel_set_encoding(channel, NULL, NULL), g_io_channel_set_buffered(channel, false);
-	if (watch)
-		g_io_add_watch(channel, G_IO_IN | G_IO_HUP, read_channel, proc), g_io_channel_unref(channel);
+	if (watch) g_io_add_watch(channel, G_IO_IN | G_IO_HUP, read_channel, proc);
 	return channel;
 }
 
 // Cleans up after the process finished executing and returned the given status code.
 static void process_finished(struct Process *proc, int status) {
+	// Read any output still in the pipes without blocking on descendants that hold them open.
+	if (proc->monitor_stdout) g_io_channel_set_flags(proc->cstdout, G_IO_FLAG_NONBLOCK, NULL);
+	if (proc->monitor_stderr) g_io_channel_set_flags(proc->cstderr, G_IO_FLAG_NONBLOCK, NULL);
+	while (proc->monitor_stdout && read_output(proc->cstdout, proc)) {}
+	while (proc->monitor_stderr && read_output(proc->cstderr, proc)) {}
 	g_source_remove_by_user_data(proc); // disconnect stdout watch
 	g_source_remove_by_user_data(proc); // disconnect stderr watch
 	g_source_remove_by_user_data(proc); // disconnect child watch
@@ -827,8 +864,8 @@ bool spawn(lua_State *L, Process *proc_, int index, const char *cmd, const char
 		&proc->fstdout, &proc->fstderr, &err);
 	if (g_strfreev(argv), !ok) return (*error = err->message, false);
 	// Monitor stdout, stderr, and the process itself.
-	proc->cstdout = new_channel(proc->fstdout, proc, monitor_stdout),
-	proc->cstderr = new_channel(proc->fstderr, proc, monitor_stderr);
+	proc->cstdout = new_channel(proc->fstdout, proc, proc->monitor_stdout = monitor_stdout),
+	proc->cstderr = new_channel(proc->fstderr, proc, proc->monitor_stderr = monitor_stderr);
 	g_child_watch_add(proc->pid, proc_exited, proc);
 	return true;
 }
@@ -881,7 +918,47 @@ void kill_process(Process *proc, int signal) {
 
 int get_process_exit_status(Process *proc) { return PROCESS(proc)->exit_status; }
 
-void cleanup_process(Process *proc) {}
+void cleanup_process(Process *proc) {
+	g_io_channel_unref(PROCESS(proc)->cstdout), g_io_channel_unref(PROCESS(proc)->cstderr);
+}
+
+static int stdin_flags; // stdin's file status flags before watching it, restored when it closes
+
+// Signal that stdin input is available for reading.
+static int read_stdin(GIOChannel *source, GIOCondition cond, void *_) {
+	char buf[PROCESS_OUTPUT_SIZE];
+	size_t len = 0;
+	GIOStatus status = g_io_channel_read_chars(source, buf, sizeof(buf), &len, NULL);
+	if (len > 0) stdin_input(buf, len);
+	if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN) return true;
+	return (fcntl(0, F_SETFL, stdin_flags), stdin_input(NULL, 0), false); // EOF or error
+}
+
+// Note: stdin's file status flags are shared with every process using the same open file, so
+// do not make a terminal non-blocking; the shell would be left with one.
+bool watch_stdin() {
+	if (isatty(0) || (stdin_flags = fcntl(0, F_GETFL)) == -1) return false;
+	GIOChannel *channel = g_io_channel_unix_new(0);
+	g_io_channel_set_encoding(channel, NULL, NULL), g_io_channel_set_buffered(channel, false);
+	g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_add_watch(channel, G_IO_IN | G_IO_HUP, read_stdin, NULL), g_io_channel_unref(channel);
+	return true;
+}
+
+static unsigned int changes_source; // ID of the source watching for file change notices, if any
+
+// Signal that file change notices are available for reading.
+static int changes_ready(GIOChannel *source, GIOCondition cond, void *_) {
+	return (file_changes_ready(), true);
+}
+
+bool watch_changes(int fd) {
+	if (changes_source) g_source_remove(changes_source), changes_source = 0;
+	if (fd == -1) return false;
+	GIOChannel *channel = g_io_channel_unix_new(fd);
+	changes_source = g_io_add_watch(channel, G_IO_IN, changes_ready, NULL);
+	return (g_io_channel_unref(channel), true);
+}
 
 void suspend() {}
 
@@ -909,8 +986,10 @@ static int process(GApplication *_, GApplicationCommandLine *line, void *__) {
 int main(int argc, char **argv) {
 	bool force = false;
 	for (int i = 0; i < argc; i++)
-		if (strcmp("-f", argv[i]) == 0 || strcmp("--force", argv[i]) == 0) {
-			force = true;
+		if (strcmp("-f", argv[i]) == 0 || strcmp("--force", argv[i]) == 0 ||
+			strcmp("-B", argv[i]) == 0 || strcmp("--batch", argv[i]) == 0 ||
+			strcmp("-b", argv[i]) == 0 || strcmp("--bench", argv[i]) == 0) {
+			force = true; // batch mode and benchmarks never forward to a running instance
 			break;
 		} else if (strcmp("-L", argv[i]) == 0 || strcmp("--lua", argv[i]) == 0)
 			return (init_textadept(argc, argv), exit_status);
@@ -926,5 +1005,5 @@ int main(int argc, char **argv) {
 		gtk_settings_get_default(), "notify::gtk-theme-name", G_CALLBACK(mode_changed), NULL);
 	gtk_main();
 
-	return (g_object_unref(app), 0); // close_textadept() was called before gtk_main_quit()
+	return (g_object_unref(app), exit_status); // close_textadept() was called before gtk_main_quit()
 }
@@ -250,6 +250,13 @@ bool add_timeout(double interval, bool (*f)(int *), int *reference);
  */
 void update_ui();
 
+/** Asks the platform to wait for and process at least one event, like spawned process output,
+ * a finished process, or a timeout.
+ * Unlike `update_ui()`, this blocks until there is something to do, so that Lua can wait on
+ * asynchronous actions without spinning.
+ */
+void wait_ui();
+
 /** Returns whether or not dark mode is currently enabled on the platform. */
 bool is_dark_mode();
 
@@ -380,6 +387,24 @@ int get_process_exit_status(Process *proc);
 /** Allows the platform to cleanup a process about to be garbage-collected by Lua. */
 void cleanup_process(Process *proc);
 
+/** Asks the platform to watch stdin for input and return whether or not it can.
+ * As input becomes available, the platform should read it without blocking and pass it to
+ * `stdin_input()`. When stdin is closed, the platform should call `stdin_input()` with a length
+ * of 0 and stop watching. Platforms should not watch a terminal, and should restore any file
+ * status flags they change on stdin once it closes.
+ * @see stdin_input
+ */
+bool watch_stdin();
+
+/** Asks the platform to watch the given file descriptor for file change notices and return
+ * whether or not it can.
+ * Whenever the descriptor is readable, the platform should call `file_changes_ready()`, which
+ * reads it. Watching a new descriptor replaces any previous one, and a descriptor of -1 means
+ * stop watching. If the platform cannot watch a descriptor, Textadept polls for changes instead.
+ * @see file_changes_ready
+ */
+bool watch_changes(int fd);
+
 /** Asks the platform to suspend execution of Textadept, if possible. */
 void suspend();
 
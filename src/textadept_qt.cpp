@@ -26,11 +26,16 @@ extern "C" {
 #include <QTreeView>
 #include <QHeaderView>
 #include <QDialogButtonBox>
-#include <QStandardItemModel>
-#include <QSortFilterProxyModel>
+#include <QAbstractTableModel>
 #include <QProcessEnvironment>
 #include <QSessionManager>
-#if _WIN32
+#include <vector>
+#if !_WIN32
+#include <QSocketNotifier>
+#include <errno.h>
+#include <fcntl.h> // for fcntl
+#include <unistd.h> // for isatty, read
+#else
 #include <QStyleFactory>
 #include <windows.h> // for GetACP
 #endif
@@ -364,6 +369,8 @@ bool add_timeout(double interval, bool (*f)(int *), int *refs) {
 
 void update_ui() { QApplication::sendPostedEvents(), QApplication::processEvents(); }
 
+void wait_ui() { QApplication::processEvents(QEventLoop::WaitForMoreEvents); }
+
 bool is_dark_mode() {
 	QPalette palette;
 	return palette.color(QPalette::WindowText).lightness() >
@@ -469,23 +476,69 @@ protected:
 	QWidget *target;
 };
 
-int list_dialog(DialogOptions opts, lua_State *L) {
-	int numColumns = opts.columns ? lua_rawlen(L, opts.columns) : 1,
-			numItems = lua_rawlen(L, opts.items);
-	QStandardItemModel model{numItems / numColumns, numColumns};
-	for (int i = 1; i <= numColumns; i++) {
-		const char *header = opts.columns ? (lua_rawgeti(L, opts.columns, i), lua_tostring(L, -1)) : "";
-		model.setHorizontalHeaderItem(i - 1, new QStandardItem{QString{header}});
-		if (opts.columns) lua_pop(L, 1); // header
+// Model for a list dialog's filtered rows.
+// Items are only converted to strings as they are displayed, so lists with many items open and
+// filter quickly.
+class ListModel : public QAbstractTableModel {
+public:
+	ListModel(lua_State *L, const DialogOptions &opts)
+			: numColumns{opts.columns ? static_cast<int>(lua_rawlen(L, opts.columns)) : 1},
+				numItems{static_cast<int>(lua_rawlen(L, opts.items))} {
+		for (int i = 1; i <= numColumns; i++) {
+			const char *header =
+				opts.columns ? (lua_rawgeti(L, opts.columns, i), lua_tostring(L, -1)) : "";
+			headers.append(QString{header});
+			if (opts.columns) lua_pop(L, 1); // header
+		}
+		// Note: items are owned by opts.items, which remains on the Lua stack.
+		items.resize(numItems);
+		for (int i = 0; i < numItems; lua_pop(L, 1), i++)
+			items[i] = (lua_rawgeti(L, opts.items, i + 1), lua_tostring(L, -1));
+		int numRows = (numItems + numColumns - 1) / numColumns; // account for non-full rows
+		searchItems.resize(numRows);
+		for (int i = 0; i < numRows; i++) {
+			int j = i * numColumns + opts.search_column - 1;
+			searchItems[i] = j < numItems ? items[j] : "";
+		}
+		init_list_filter(&filter, searchItems.data(), numRows);
 	}
-	for (int i = 0; i < numItems; lua_pop(L, 1), i++) {
-		const char *item = (lua_rawgeti(L, opts.items, i + 1), lua_tostring(L, -1));
-		auto qitem = new QStandardItem{QString{item}};
-		model.setItem(i / numColumns, i % numColumns, (qitem->setEditable(false), qitem));
+	~ListModel() override { free_list_filter(&filter); }
+
+	int rowCount(const QModelIndex &parent = QModelIndex{}) const override {
+		return parent.isValid() ? 0 : filter.num_matches;
+	}
+	int columnCount(const QModelIndex &parent = QModelIndex{}) const override {
+		return parent.isValid() ? 0 : numColumns;
+	}
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override {
+		if (role != Qt::DisplayRole || !index.isValid() || index.row() >= filter.num_matches)
+			return QVariant{};
+		int i = sourceRow(index.row()) * numColumns + index.column();
+		return i < numItems ? QString{items[i]} : QString{};
+	}
+	QVariant headerData(int section, Qt::Orientation orientation, int role) const override {
+		if (role != Qt::DisplayRole || orientation != Qt::Horizontal || section >= headers.size())
+			return QVariant{};
+		return headers[section];
 	}
-	QSortFilterProxyModel filter;
-	filter.setFilterKeyColumn(opts.search_column - 1);
-	filter.setSourceModel(&model);
+
+	// Filters rows by the given search key.
+	void setKey(const QString &key) {
+		beginResetModel(), filter_list(&filter, key.toUtf8().constData()), endResetModel();
+	}
+	// Returns the index of the row displayed in the given filtered row.
+	int sourceRow(int row) const { return filter.matches[row]; }
+
+private:
+	int numColumns, numItems;
+	QStringList headers;
+	std::vector<const char *> items, searchItems;
+	ListFilter filter;
+};
+
+int list_dialog(DialogOptions opts, lua_State *L) {
+	int numColumns = opts.columns ? lua_rawlen(L, opts.columns) : 1;
+	ListModel model{L, opts};
 
 	QDialog dialog{ta};
 	auto vbox = new QVBoxLayout{&dialog};
@@ -493,7 +546,7 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	auto lineEdit = new QLineEdit;
 	QObject::connect(lineEdit, &QLineEdit::returnPressed, &dialog, &QDialog::accept);
 	auto treeView = new QTreeView;
-	treeView->setModel(&filter);
+	treeView->setModel(&model), treeView->setUniformRowHeights(true);
 	treeView->setHeaderHidden(!opts.columns), treeView->setIndentation(0);
 	treeView->header()->resizeSections(QHeaderView::ResizeToContents);
 	treeView->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -501,18 +554,12 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	if (opts.multiple) treeView->setSelectionMode(QAbstractItemView::ExtendedSelection);
 	QItemSelectionModel *selection = treeView->selectionModel();
 	QObject::connect(
-		lineEdit, &QLineEdit::textChanged, &filter, [&filter, &selection](const QString &text) {
-			// TODO: Qt 5.15 introduced QRegularExpression::escape().
-			// QString re = QRegularExpression::escape(text).replace("\\ ", ".*");
-			QString re =
-				QString{text}.replace(QRegularExpression{"([^A-Za-z0-9_])"}, "\\\\1").replace("\\ ", ".*");
-			filter.setFilterRegularExpression(
-				QRegularExpression{re, QRegularExpression::CaseInsensitiveOption});
-			selection->select(
-				filter.index(0, 0), QItemSelectionModel::Select | QItemSelectionModel::Rows);
+		lineEdit, &QLineEdit::textChanged, &model, [&model, &selection](const QString &text) {
+			model.setKey(text);
+			selection->select(model.index(0, 0), QItemSelectionModel::Select | QItemSelectionModel::Rows);
 		});
 	if (opts.text) lineEdit->setText(opts.text);
-	selection->select(filter.index(0, 0), QItemSelectionModel::Select | QItemSelectionModel::Rows);
+	selection->select(model.index(0, 0), QItemSelectionModel::Select | QItemSelectionModel::Rows);
 	lineEdit->installEventFilter(new KeyForwarder{treeView, &dialog});
 	auto buttonBox = new QDialogButtonBox;
 	int buttonClicked = 1; // ok/accept by default
@@ -537,7 +584,7 @@ int list_dialog(DialogOptions opts, lua_State *L) {
 	if (!ok && !opts.return_button) return 0;
 	lua_newtable(L); // note: will be replaced by a single result if opts.multiple is false
 	for (int i = 0; i < selection->selectedRows(0).size(); i++)
-		lua_pushinteger(L, filter.mapToSource(selection->selectedRows(0)[i]).row() + 1),
+		lua_pushinteger(L, model.sourceRow(selection->selectedRows(0)[i].row()) + 1),
 			lua_rawseti(L, -2, i + 1);
 	if (!opts.multiple) lua_rawgeti(L, -1, 1), lua_replace(L, -2); // single value
 	return !opts.return_button ? 1 : (lua_pushinteger(L, ok ? buttonClicked : 2), 2);
@@ -592,12 +639,12 @@ bool spawn(lua_State *L, Process *proc, int /*index*/, const char *cmd, const ch
 	if (monitor_stdout)
 		QObject::connect(qProc, &QProcess::readyReadStandardOutput, qProc, [proc, qProc]() {
 			QByteArray bytes = qProc->readAllStandardOutput();
-			process_output(proc, bytes.data(), bytes.size(), true);
+			process_output(proc, bytes.data(), bytes.size(), true), flush_process_output(proc);
 		});
 	if (monitor_stderr)
 		QObject::connect(qProc, &QProcess::readyReadStandardError, qProc, [proc, qProc]() {
 			QByteArray bytes = qProc->readAllStandardError();
-			process_output(proc, bytes.data(), bytes.size(), false);
+			process_output(proc, bytes.data(), bytes.size(), false), flush_process_output(proc);
 		});
 	QObject::connect(qProc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), qProc,
 		[proc](int exitCode, QProcess::ExitStatus) { process_exited(proc, exitCode); });
@@ -654,6 +701,42 @@ void cleanup_process(Process *proc) {
 	delete PROCESS(proc);
 }
 
+// Note: stdin's file status flags are shared with every process using the same open file, so
+// do not make a terminal non-blocking; the shell would be left with one. Restore the original
+// flags when stdin closes.
+bool watch_stdin() {
+#if !_WIN32
+	int flags = fcntl(0, F_GETFL);
+	if (isatty(0) || flags == -1) return false;
+	fcntl(0, F_SETFL, flags | O_NONBLOCK);
+	auto notifier = new QSocketNotifier{0, QSocketNotifier::Read, ta};
+	QObject::connect(notifier, &QSocketNotifier::activated, notifier, [notifier, flags]() {
+		char buf[PROCESS_OUTPUT_SIZE];
+		ssize_t len = read(0, buf, sizeof(buf));
+		if (len > 0) return stdin_input(buf, len);
+		if (len < 0 && (errno == EAGAIN || errno == EINTR)) return;
+		fcntl(0, F_SETFL, flags);
+		notifier->setEnabled(false), notifier->deleteLater(), stdin_input(nullptr, 0);
+	});
+	return true;
+#else
+	return false; // QSocketNotifier cannot watch pipes on Windows
+#endif
+}
+
+bool watch_changes(int fd) {
+#if !_WIN32
+	static QSocketNotifier *notifier;
+	if (notifier) notifier->setEnabled(false), notifier->deleteLater(), notifier = nullptr;
+	if (fd == -1) return false;
+	notifier = new QSocketNotifier{fd, QSocketNotifier::Read, ta};
+	QObject::connect(notifier, &QSocketNotifier::activated, notifier, file_changes_ready);
+	return true;
+#else
+	return false; // there are no file change notice descriptors on Windows
+#endif
+}
+
 void suspend() {}
 
 void quit() { ta->close(); }
@@ -732,7 +815,7 @@ void Textadept::keyPressEvent(QKeyEvent *ev) {
 class Application : public SingleApplication {
 public:
 	Application(int &argc, char **argv) : SingleApplication{argc, argv, true} {
-		const std::vector<const char *> args{"-f", "--force", "-L", "--lua"};
+		const std::vector<const char *> args{"-f", "--force", "-L", "--lua", "-B", "--batch"};
 		bool force =
 			std::any_of(args.begin(), args.end(), [](const char *s) { return arguments().contains(s); });
 		if (isSecondary() && !force) {
@@ -779,7 +862,7 @@ public:
 		if (inited) delete ta;
 	}
 
-	int exec() { return inited ? QApplication::exec() : exit_status; }
+	int exec() { return inited ? (QApplication::exec(), exit_status) : exit_status; }
 
 protected:
 	bool event(QEvent *event) override {
@@ -793,4 +876,11 @@ private:
 	bool inited = false;
 };
 
-int main(int argc, char *argv[]) { return Application{argc, argv}.exec(); }
+int main(int argc, char *argv[]) {
+	// Batch mode and benchmarks run headless, so use a platform plugin that does not need a display.
+	for (int i = 0; i < argc; i++)
+		if (strcmp("-B", argv[i]) == 0 || strcmp("--batch", argv[i]) == 0 ||
+			strcmp("-b", argv[i]) == 0 || strcmp("--bench", argv[i]) == 0)
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+	return Application{argc, argv}.exec();
+}
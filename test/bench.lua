@@ -0,0 +1,276 @@
+-- Copyright 2023 Mitchell. See LICENSE.
+
+-- Benchmark suite for catching performance regressions.
+-- Run with `textadept -n -u /tmp/bench -b [patterns]`, or build the "bench" CMake target.
+-- Each benchmark runs against a generated corpus of a large file, a deep directory tree, and
+-- noisy process output. Results are written as tab-separated values to *_USERHOME/bench.tsv*
+-- and compared against *_USERHOME/bench_baseline.tsv* if it exists. Copy the results of one
+-- commit to the baseline file in order to compare another commit with it.
+-- Times are in seconds of wall-clock time, and are the median of several runs. (CPU time would
+-- miss time spent waiting on the filesystem, on child processes, and on worker threads.)
+-- Like batch mode, benchmarks run headless: a report is printed to stdout and written to
+-- *_USERHOME/bench.txt* before Textadept quits.
+
+--- The number of times to run each benchmark.
+local RUNS = 5
+--- The fraction by which a benchmark must be slower than its baseline in order to be reported
+-- as a regression.
+local THRESHOLD = 0.1
+
+--- The number of lines in the large file.
+local LARGE_FILE_LINES = 100000
+--- The depth of the directory tree, and the number of subdirectories in each directory.
+local TREE_DEPTH, TREE_WIDTH = 3, 8
+--- The number of files in each directory of the tree, and the number of lines in each file.
+local TREE_FILES, TREE_FILE_LINES = 4, 50
+--- The number of lines of noisy process output.
+local OUTPUT_LINES = 200000
+
+--- Includes the startup time, which is measured from the start of Textadept until benchmarks
+-- start, after all `events.INITIALIZED` handlers have been called.
+local startup = os._clock()
+
+--- Writes string *text* to file *filename*.
+local function write_file(filename, text)
+	local f = assert(io.open(filename, 'wb'))
+	f:write(text)
+	f:close()
+end
+
+--- Generates the benchmark corpus in directory *dir* and returns a table of its files.
+local function generate_corpus(dir)
+	local corpus = {dir = dir, large = dir .. '/large.lua', tree = dir .. '/tree',
+		output = dir .. '/output.txt'}
+	assert(lfs.mkdir(dir))
+	local lines = {}
+	for i = 1, LARGE_FILE_LINES do
+		lines[i] = string.format('local var%d = function(a, b) return a + b * %d end -- comment %d',
+			i, i, i)
+	end
+	write_file(corpus.large, table.concat(lines, '\n'))
+	local function generate_tree(dir, depth)
+		assert(lfs.mkdir(dir))
+		for i = 1, TREE_FILES do
+			local lines = {}
+			for j = 1, TREE_FILE_LINES do
+				lines[j] = j % 10 == 0 and string.format('foo(%d, %d)', i, j) or
+					string.format('bar = baz(%d, %d)', i, j)
+			end
+			write_file(string.format('%s/file%d.lua', dir, i), table.concat(lines, '\n'))
+		end
+		if depth == TREE_DEPTH then return end
+		for i = 1, TREE_WIDTH do generate_tree(string.format('%s/dir%d', dir, i), depth + 1) end
+	end
+	generate_tree(corpus.tree, 1)
+	lines = {}
+	for i = 1, OUTPUT_LINES do
+		lines[i] = string.format('file%d.c:%d:%d: warning: something noisy happened [-Wnoise]', i,
+			i % 1000, i % 80)
+	end
+	write_file(corpus.output, table.concat(lines, '\n'))
+	return corpus
+end
+
+--- Removes directory *dir* and its contents.
+local function removedir(dir) os.execute((not WIN32 and 'rm -r ' or 'rmdir /S /Q ') .. dir) end
+
+--- Returns the wall-clock time it takes to call function *f* with the given arguments.
+local function time(f, ...)
+	collectgarbage()
+	local start = os._clock()
+	f(...)
+	return os._clock() - start
+end
+
+--- Reads and returns the contents of file *filename*.
+local function read_file(filename)
+	local f = assert(io.open(filename, 'rb'))
+	local contents = f:read('a')
+	f:close()
+	return contents
+end
+
+--- Opens a new buffer with the contents of the large file.
+local function new_large_buffer(corpus)
+	buffer.new()
+	buffer:set_text(read_file(corpus.large))
+	buffer:empty_undo_buffer()
+end
+
+--------------------------------------------------------------------------------
+
+-- Each benchmark is passed the corpus and returns the time it took, along with the number of
+-- units it processed and the name of those units.
+
+function bench_io_open_file(corpus)
+	local seconds = time(io.open_file, corpus.large)
+	buffer:close(true)
+	return seconds, LARGE_FILE_LINES, 'lines'
+end
+
+function bench_lfs_walk(corpus)
+	local files = 0
+	local seconds = time(function() for _ in lfs.walk(corpus.tree) do files = files + 1 end end)
+	return seconds, files, 'files'
+end
+
+function bench_find_in_files(corpus)
+	ui.find.find_entry_text = 'foo'
+	local seconds = time(ui.find.find_in_files, corpus.tree, {})
+	local found = 0
+	for _ in buffer:get_text():gmatch('\n[^\n]+:%d+:') do found = found + 1 end
+	ui.find.find_entry_text = ''
+	buffer:close(true)
+	while view:unsplit() do end
+	return seconds, found, 'matches'
+end
+
+function bench_lexer_style_needed(corpus)
+	new_large_buffer(corpus)
+	buffer:set_lexer('lua')
+	local seconds = time(buffer.colorize, buffer, 1, -1)
+	buffer:close(true)
+	return seconds, LARGE_FILE_LINES, 'lines'
+end
+
+function bench_autocompleters_word(corpus)
+	new_large_buffer(corpus)
+	buffer:document_end()
+	buffer:new_line()
+	buffer:add_text('va')
+	local completions
+	local seconds = time(function()
+		completions = select(2, textadept.editing.autocompleters.word())
+	end)
+	assert(#completions == LARGE_FILE_LINES, 'unexpected number of completions')
+	buffer:close(true)
+	return seconds, LARGE_FILE_LINES, 'words'
+end
+
+function bench_replace_all(corpus)
+	new_large_buffer(corpus)
+	ui.find.find_entry_text, ui.find.replace_entry_text = 'var', 'VAR'
+	local seconds = time(ui.find.replace_all)
+	ui.find.find_entry_text, ui.find.replace_entry_text = '', ''
+	buffer:close(true)
+	return seconds, LARGE_FILE_LINES, 'replacements'
+end
+
+function bench_ui_output(corpus)
+	local output = read_file(corpus.output)
+	local seconds = time(function()
+		for i = 1, #output, 0x10000 do ui.output_silent(output:sub(i, i + 0x10000 - 1)) end
+	end)
+	for _, buffer in ipairs(_BUFFERS) do
+		if buffer._type == _L['[Output Buffer]'] then
+			buffer:close(true)
+			break
+		end
+	end
+	while view:unsplit() do end
+	return seconds, OUTPUT_LINES, 'lines'
+end
+
+function bench_os_spawn_output(corpus)
+	local cmd = not WIN32 and 'cat "' .. corpus.output .. '"' or 'type "' .. corpus.output .. '"'
+	local bytes = 0
+	local seconds = time(function() bytes = #assert(os.spawn(cmd)):read('a') end)
+	return seconds, bytes, 'bytes'
+end
+
+--------------------------------------------------------------------------------
+
+local BENCH_OUTPUT_BUFFER = '[Benchmark Output]'
+local function print(...) ui.print_to(BENCH_OUTPUT_BUFFER, ...) end
+
+-- Determines whether or not to run the benchmark whose name is string *name*.
+-- This follows the same rules as the unit test suite's patterns.
+local function include_bench(name)
+	if #arg == 0 then return true end
+	local include, includes, excludes = false, false, false
+	for _, patt in ipairs(arg) do
+		if patt:find('^%-') then
+			if name:find(patt:sub(2)) then return false end
+			excludes = true
+		else
+			if name:find(patt) then include = true end
+			includes = true
+		end
+	end
+	return include or not includes and excludes
+end
+
+--- Reads and returns a map of benchmark names to their results from file *filename*, if it exists.
+local function read_results(filename)
+	local f = io.open(filename, 'rb')
+	if not f then return nil end
+	local results = {}
+	for line in f:lines() do
+		local name, seconds, units, unit = line:match('^([^#\t]+)\t([^\t]+)\t([^\t]+)\t([^\t]+)$')
+		if name then results[name] = {tonumber(seconds), tonumber(units), unit} end
+	end
+	f:close()
+	return results
+end
+
+local benchmarks = {}
+for k in pairs(_ENV) do
+	if k:find('^bench_') and include_bench(k) then benchmarks[#benchmarks + 1] = k end
+end
+table.sort(benchmarks)
+
+local results, order = {startup = {startup, 1, 'starts'}}, {'startup'}
+local dir = os.tmpname()
+if not WIN32 then os.remove(dir) end -- os.tmpname() created a file
+local corpus = generate_corpus(dir)
+print('Starting benchmarks')
+for _, name in ipairs(benchmarks) do
+	print(string.format('Running %s', name))
+	ui.update()
+	local times, units, unit = {}, nil, nil
+	for i = 1, RUNS do
+		local ok, seconds, n, u = pcall(_ENV[name], corpus)
+		if not ok then
+			print(string.format('Failed! %s', seconds))
+			times = nil
+			break
+		end
+		times[i], units, unit = seconds, n, u
+	end
+	if times then
+		table.sort(times)
+		local short_name = name:sub(#'bench_' + 1)
+		results[short_name], order[#order + 1] = {times[(RUNS + 1) // 2], units, unit}, short_name
+	end
+end
+removedir(corpus.dir)
+
+local lines = {'# name\tseconds\tunits\tunit'}
+for _, name in ipairs(order) do
+	lines[#lines + 1] = string.format('%s\t%.6f\t%d\t%s', name, table.unpack(results[name]))
+end
+write_file(_USERHOME .. '/bench.tsv', table.concat(lines, '\n') .. '\n')
+
+local baseline, regressions, report = read_results(_USERHOME .. '/bench_baseline.tsv'), 0, {}
+for _, name in ipairs(order) do
+	local seconds, units, unit = table.unpack(results[name])
+	local line = string.format('%-24s %10.4fs %14.0f %s/s', name, seconds,
+		seconds > 0 and units / seconds or 0, unit)
+	local base = baseline and baseline[name]
+	if base and base[1] > 0 then
+		local change = (seconds - base[1]) / base[1]
+		line = string.format('%s %+7.1f%%%s', line, change * 100,
+			change > THRESHOLD and ' REGRESSION' or '')
+		if change > THRESHOLD then regressions = regressions + 1 end
+	end
+	report[#report + 1] = line
+end
+report[#report + 1] = string.format('%d benchmarks run, %d regressions', #order, regressions)
+print(table.concat(report, '\n'))
+io.stdout:write(table.concat(report, '\n'), '\n'):flush()
+write_file(_USERHOME .. '/bench.txt', table.concat(report, '\n') .. '\n')
+
+while view:unsplit() do end
+while #_BUFFERS > 1 do buffer:close(true) end
+buffer:close(true)
+quit()
@@ -103,6 +103,119 @@ function test_assert_types()
 	assert_raises(function() foo(1) end, "bad argument #3 to 'assert_type' (value expected, got nil")
 end
 
+function test_loadfile_bytecode_cache()
+	local userhome = _USERHOME
+	_USERHOME = os.tmpname()
+	os.remove(_USERHOME)
+	lfs.mkdir(_USERHOME)
+	local function cached()
+		local n = 0
+		for name in lfs.dir(_USERHOME .. '/cache') do if name:find('%.luac$') then n = n + 1 end end
+		return n
+	end
+	local filename = os.tmpname()
+	io.open(filename, 'wb'):write('return 1, ...'):close()
+	assert_equal(loadfile(filename)(), 1)
+	assert_equal(lfs.attributes(_USERHOME .. '/cache', 'mode'), 'directory')
+	assert_equal(cached(), 1)
+	assert_equal(select(2, loadfile(filename)(2)), 2) -- cached
+	assert_equal(dofile(filename), 1)
+	io.open(filename, 'wb'):write('return 2, ...'):close() -- same size and (likely) time
+	assert_equal(dofile(filename), 2)
+	io.open(filename, 'wb'):write('return x'):close()
+	assert_equal(loadfile(filename, 'bt', {x = 3})(), 3)
+	local filename2 = os.tmpname()
+	io.open(filename2, 'wb'):write('return 4'):close()
+	assert_equal(loadfile(filename2, 't')(), 4)
+	assert_equal(cached(), 1) -- text-only loads bypass the cache
+	io.open(filename, 'wb'):write('return 1 +'):close()
+	local f, errmsg = loadfile(filename)
+	assert(not f, 'syntax error should not be loaded from cache')
+	assert(errmsg:find('^' .. filename:gsub('%p', '%%%0')), 'error should refer to source file')
+	assert_raises(function() dofile(filename) end, 'unexpected symbol')
+	os.remove(filename)
+	os.remove(filename2)
+	removedir(_USERHOME)
+	_USERHOME = userhome -- reset
+end
+
+function test_profile()
+	local checks = [[
+		local event, handler = 'profile_event', function() buffer:get_text() end
+		events.connect(event, handler)
+		local stats = _PROFILE.stats
+		local calls = stats['event: ' .. event] and stats['event: ' .. event].count or 0
+		events.emit(event)
+		events.disconnect(event, handler)
+		assert(stats['event: ' .. event].count == calls + 1, 'should have profiled event')
+		assert(stats.scintilla.count > 0, 'should have profiled Scintilla calls')
+		assert(stats['startup: core/init.lua'], 'should have profiled startup')
+		_PROFILE.write_trace(...)
+	]]
+	if not _PROFILE and WIN32 and CURSES then return end -- batch mode is not supported
+	local filename = os.tmpname()
+	if _PROFILE then
+		assert(load(checks))(filename)
+	else
+		-- Profile a separate instance run with -P as a batch script.
+		local script = os.tmpname()
+		local f = io.open(script, 'wb')
+		f:write(string.format('assert(load(%q))(%q)\n', checks, filename))
+		f:close()
+		local exe = _G.arg[0]:find('[/\\]') and lfs.abspath(_G.arg[0]) or _G.arg[0]
+		local p = os.spawn(string.format('"%s" -n -u "%s" -P -B "%s"', exe, _USERHOME, script))
+		local output = p:read('a')
+		assert(p:wait() == 0, output)
+		os.remove(script)
+	end
+	local f = io.open(filename)
+	local trace = f:read('a')
+	f:close()
+	assert(trace:find('"name":"startup: core/init.lua","ph":"X"', 1, true), 'should have traced startup')
+	os.remove(filename)
+end
+
+function test_args_batch()
+	if WIN32 and CURSES then return end -- not supported
+	local dir, script = os.tmpname(), os.tmpname()
+	os.remove(dir)
+	lfs.mkdir(dir)
+	for _, name in ipairs{'foo', 'bar', 'baz'} do
+		local f = io.open(dir .. '/' .. name, 'wb')
+		f:write(name)
+		f:close()
+	end
+	local f = io.open(script, 'wb')
+	f:write("if ... and ...:find('baz$') then error('oops') end\n",
+		'buffer:set_text(buffer:get_text():upper())\n')
+	f:close()
+	local exe = _G.arg[0]:find('[/\\]') and lfs.abspath(_G.arg[0]) or _G.arg[0]
+	local cmd = string.format('"%s" -n -u "%s" -j 2 -B "%s" "%s"', exe, _USERHOME, script, dir)
+	local p = os.spawn(cmd)
+	local output = p:read('a')
+	assert(p:wait() ~= 0, 'should have failed')
+	assert(output:find('baz: .-oops'), 'error not reported')
+	for name, text in pairs{foo = 'FOO', bar = 'BAR', baz = 'baz'} do
+		f = io.open(dir .. '/' .. name, 'rb')
+		assert_equal(f:read('a'):match('^%S+'), text)
+		f:close()
+	end
+	if not WIN32 then
+		-- Test passing a script name that contains a double quote to workers.
+		local quoted_script = script .. '"'
+		os.rename(script, quoted_script)
+		script = quoted_script
+		cmd = string.format([['%s' -n -u '%s' -j 2 -B '%s' '%s']], exe, _USERHOME, script, dir)
+		p = os.spawn(cmd)
+		output = p:read('a')
+		assert(p:wait() ~= 0, 'should have failed')
+		assert(output:find('baz: .-oops'), 'error not reported')
+		assert(not output:find('cannot open'), 'workers could not find script')
+	end
+	removedir(dir)
+	os.remove(script)
+end
+
 function test_events_basic()
 	local emitted = false
 	local event, handler = 'test_basic', function() emitted = true end
@@ -184,6 +297,29 @@ function test_events_value_passing()
 	assert_equal(events.emit(event), {1, 2, 3})
 end
 
+function test_events_scintilla_notifications()
+	local zoomed, modified = false, {}
+	local zoom_handler = function() zoomed = true end
+	local modified_handler = function(position, mod, text, length)
+		if mod & buffer.MOD_INSERTTEXT > 0 then modified = {position, text, length} end
+	end
+	events.connect(events.ZOOM, zoom_handler)
+	events.connect(events.MODIFIED, modified_handler)
+	buffer.new()
+	buffer:add_text('foo')
+	assert_equal(modified, {1, 'foo', 3})
+	local zoom = view.zoom
+	view:zoom_in()
+	assert(zoomed, 'zoom notification not emitted')
+	events.disconnect(events.ZOOM, zoom_handler)
+	zoomed = false
+	view:zoom_out()
+	assert(not zoomed, 'disconnected handler called')
+	assert_equal(view.zoom, zoom)
+	events.disconnect(events.MODIFIED, modified_handler)
+	buffer:close(true)
+end
+
 function test_lexer_get_lexer()
 	buffer.new()
 	buffer:set_lexer('html')
@@ -249,6 +385,70 @@ function test_lexer_set_lexer_after_buffer_switch()
 	buffer:close(true)
 end
 
+function test_lexer_set_lexer_shared()
+	buffer.new()
+	buffer:set_lexer('html')
+	local html, property = buffer.lexer, {}
+	for k, v in pairs(buffer.property) do property[k] = v end
+	buffer.new()
+	buffer:set_lexer('html')
+	assert(buffer.lexer == html, 'lexer not shared')
+	for k, v in pairs(property) do assert_equal(buffer.property[k], v) end
+	buffer:set_text('<p>foo</p>')
+	buffer:colorize(1, -1)
+	assert_equal(buffer:name_of_style(buffer.style_at[1]), 'tag')
+	buffer:close(true)
+	buffer:close(true)
+end
+
+function test_lexer_set_lexer_reloads_after_reset()
+	buffer.new()
+	buffer:set_lexer('lua')
+	local lua = buffer.lexer
+	reset()
+	buffer:set_lexer('lua') -- the original set_lexer() persists through reset
+	assert(buffer.lexer ~= lua, 'lexer not reloaded')
+	buffer:close(true)
+end
+
+function test_lexer_restyle_within_long_token()
+	buffer.new()
+	buffer:set_lexer('lua')
+	buffer:set_text('x = 1\n--[[' .. string.rep('comment\n', 1000) .. ']]\ny = 2')
+	buffer:colorize(1, -1)
+	local pos = buffer:position_from_line(500)
+	buffer:insert_text(pos, 'foo')
+	buffer:colorize(pos, -1)
+	assert(buffer:name_of_style(buffer.style_at[pos]):find('^comment'), 'not a comment style')
+	assert(buffer:name_of_style(buffer.style_at[1]):find('^identifier'), 'not an identifier style')
+	assert(buffer:name_of_style(buffer.style_at[buffer.length]):find('^number'), 'not a number style')
+	buffer:close(true)
+end
+
+function test_lexer_highlight_styles_every_position()
+	buffer.new()
+	buffer:set_lexer('lua')
+	local text = 'local s = "été" -- comment\nx = {1, 2}\n'
+	buffer:set_text(text)
+	buffer:colorize(1, -1)
+	local function test_styles()
+		local styles, tags, pos = buffer.lexer:lex(text, view.STYLE_DEFAULT), buffer.lexer._TAGS, 1
+		for i = 1, #styles, 2 do
+			for j = pos, styles[i + 1] - 1 do assert_equal(buffer.style_at[j], tags[styles[i]]) end
+			pos = styles[i + 1]
+		end
+		assert_equal(pos, buffer.length + 1)
+		assert_equal(buffer.end_styled, buffer.length + 1)
+	end
+	test_styles()
+	local pos = buffer:position_from_line(2)
+	buffer:start_styling(pos, 0)
+	buffer:set_styling(buffer.length + 1 - pos, view.STYLE_DEFAULT)
+	buffer:colorize(pos, -1) -- restyle part of the buffer
+	test_styles()
+	buffer:close(true)
+end
+
 function test_lexer_load_lexers()
 	local lexers = {}
 	for file in lfs.dir(_LEXERPATH:match('[^;]+$')) do -- just _HOME/lexers
@@ -390,6 +590,46 @@ function test_file_io_open_file_detect_encoding()
 	-- TODO: encoding failure
 end
 
+function test_file_io_open_file_detect_bom()
+	local filename = os.tmpname()
+	io.open(filename, 'wb'):write(string.iconv('\u{FEFF}schön', 'UTF-16LE', 'UTF-8')):close()
+	io.open_file(filename)
+	assert_equal(buffer.encoding, 'UTF-16')
+	assert_equal(buffer:get_text(), 'schön')
+	buffer:close()
+	io.open(filename, 'wb'):write('\239\187\191schön'):close()
+	io.open_file(filename)
+	assert_equal(buffer.encoding, 'UTF-8')
+	buffer:close()
+	os.remove(filename)
+end
+
+function test_string_is_utf8()
+	assert(string.is_utf8(''), 'empty string is valid')
+	assert(string.is_utf8('foo bar baz quux'), 'ASCII is valid')
+	assert(string.is_utf8('schön, 日本語, \u{10FFFF}'), 'multibyte characters are valid')
+	assert(not string.is_utf8('sch\246n'), 'CP1252 is invalid')
+	assert(not string.is_utf8('foo\195'), 'truncated sequence is invalid')
+	assert(not string.is_utf8('\192\128'), 'overlong encoding is invalid')
+	assert(not string.is_utf8('\237\160\128'), 'surrogate is invalid')
+	assert(not string.is_utf8('\244\144\128\128'), 'code point beyond U+10FFFF is invalid')
+	assert_raises(function() string.is_utf8() end, 'string expected, got no value')
+end
+
+function test_string_iconv_open()
+	local text = 'schön, 日本語'
+	local conv = string.iconv_open('UTF-16LE', 'UTF-8')
+	local chunks = {}
+	for i = 1, #text do chunks[#chunks + 1] = conv:convert(text:sub(i, i)) end -- split sequences
+	chunks[#chunks + 1] = conv:convert()
+	assert_equal(table.concat(chunks), text:iconv('UTF-16LE', 'UTF-8'))
+	assert_equal(conv:convert('foo\195'), string.iconv('foo', 'UTF-16LE', 'UTF-8'))
+	assert_raises(function() conv:convert() end, 'conversion failed') -- incomplete sequence
+	conv:close()
+	assert_raises(function() conv:convert('foo') end, 'converter is closed')
+	assert_raises(function() string.iconv_open('foo', 'bar') end, 'invalid encoding(s)')
+end
+
 function test_file_io_open_file_detect_newlines()
 	local files = {
 		[file(_HOME .. '/test/file_io/lf')] = buffer.EOL_LF,
@@ -465,6 +705,23 @@ function test_file_io_open_set_lexer()
 	buffer:close()
 end
 
+function test_file_io_open_large_file()
+	local large_file_size = io.large_file_size
+	io.large_file_size = 1
+	io.open_file(_HOME .. '/src/textadept.c')
+	assert_equal(buffer.lexer_language, 'text')
+	assert_equal(buffer.undo_collection, false)
+	assert_equal(buffer.encoding, 'UTF-8')
+	assert_equal(buffer.modify, false)
+	buffer:close()
+	io.large_file_size = nil
+	io.open_file(_HOME .. '/src/textadept.c')
+	assert_equal(buffer.lexer_language, 'ansi_c')
+	assert_equal(buffer.undo_collection, true)
+	buffer:close()
+	io.large_file_size = large_file_size -- restore
+end
+
 function test_file_io_reload_file()
 	io.open_file(_HOME .. '/test/file_io/utf8')
 	local pos = 10
@@ -529,6 +786,71 @@ function test_file_io_save_file()
 	assert_raises(function() buffer:save_as(1) end, 'string/nil expected, got number')
 end
 
+function test_file_io_save_atomic()
+	local filename = os.tmpname()
+	local link = filename .. '.link'
+	if not WIN32 then
+		os.execute(string.format('chmod 640 "%s" && ln -s "%s" "%s"', filename, filename, link))
+	end
+	buffer.new()
+	buffer:append_text('foo')
+	buffer:save_as(not WIN32 and link or filename)
+	local dir, name = filename:match('^(.+)[/\\]([^/\\]+)$')
+	for file in lfs.dir(dir) do
+		assert(not file:find(name .. '.textadept~', 1, true), 'temporary file not removed')
+	end
+	local f = assert(io.open(filename, 'rb'))
+	assert_equal(f:read('a'), buffer:get_text())
+	f:close()
+	if not WIN32 then
+		assert_equal(lfs.symlinkattributes(link, 'mode'), 'link')
+		assert_equal(lfs.attributes(filename, 'permissions'), 'rw-r-----')
+		os.remove(link)
+	end
+	buffer:close()
+	os.remove(filename)
+
+	local results = io._write_files{{filename, 'foo', 'bar'}, {filename .. '/does/not/exist', ''}}
+	assert_equal(results[1], true)
+	assert(type(results[2]) == 'string' and results[2]:find('does/not/exist'), 'no write error')
+	f = assert(io.open(filename, 'rb'))
+	assert_equal(f:read('a'), 'foobar')
+	f:close()
+	assert_raises(function() io._write_files{{}} end, 'filename expected')
+	assert_raises(function() io._write_files{'foo'} end, 'list of tables expected')
+
+	buffer.new()
+	buffer:set_text('schön')
+	local hashes
+	results, hashes = io._write_files{{filename, 'foo', buffer = buffer, encoding = 'UTF-16LE'}}
+	assert_equal(results[1], true)
+	f = assert(io.open(filename, 'rb'))
+	local written = f:read('a')
+	f:close()
+	assert_equal(written, ('fooschön'):iconv('UTF-16LE', 'UTF-8'))
+	assert_equal(hashes[1], io._hash(written))
+	results = io._write_files{{filename, buffer = buffer, encoding = 'ASCII'}}
+	assert(type(results[1]) == 'string', 'no conversion error')
+	f = assert(io.open(filename, 'rb'))
+	assert_equal(f:read('a'), written) -- not clobbered
+	f:close()
+	results = io._write_files{{filename, buffer = buffer, encoding = 'invalid'}}
+	assert(results[1]:find('invalid encoding'), 'no encoding error')
+	buffer:close(true)
+	assert_raises(function() io._write_files{{filename, buffer = 'foo'}} end, 'Buffer expected')
+
+	if not WIN32 then
+		local hard_link = filename .. '.hard'
+		os.execute(string.format('ln "%s" "%s"', filename, hard_link))
+		assert_equal(io._write_files{{filename, 'baz'}}[1], true)
+		f = assert(io.open(hard_link, 'rb'))
+		assert_equal(f:read('a'), 'baz') -- written in place
+		f:close()
+		os.remove(hard_link)
+	end
+	os.remove(filename)
+end
+
 function test_file_io_save_as_set_lexer()
 	buffer.new()
 	assert_equal(buffer.lexer_language, 'text')
@@ -666,6 +988,137 @@ function test_file_io_file_detect_modified_interactive()
 	os.remove(filename)
 end
 
+function test_file_io_file_detect_modified_ignores_unchanged_contents()
+	local modified = false
+	local handler = function()
+		modified = true
+		return false -- halt propagation
+	end
+	events.connect(events.FILE_CHANGED, handler, 1)
+	local filename = os.tmpname()
+	local f = assert(io.open(filename, 'wb'))
+	f:write('foo\n'):close()
+	io.open_file(filename)
+	view:goto_buffer(-1)
+	sleep(1) -- filesystem mod time has 1-second granularity
+	f = assert(io.open(filename, 'wb'))
+	f:write('foo\n'):close() -- only the mod time changes
+	view:goto_buffer(1)
+	assert_equal(modified, false)
+	buffer:close()
+	os.remove(filename)
+	events.disconnect(events.FILE_CHANGED, handler)
+end
+
+function test_file_io_watch_reports_changes_once()
+	local dir = os.tmpname()
+	os.remove(dir)
+	lfs.mkdir(dir)
+	lfs.mkdir(dir .. '/sub')
+	local filename1, filename2 = dir .. '/foo', dir .. '/sub/bar'
+	io.open(filename1, 'wb'):write('foo\n'):close()
+	io.open(filename2, 'wb'):write('bar\n'):close()
+	local link = filename2
+	if not WIN32 then
+		link = dir .. '/link'
+		os.execute(string.format('ln -s "%s" "%s"', filename2, link))
+	end
+	io.open_file(filename1)
+	local buffer1 = buffer
+	io.open_file(link) -- the watcher should watch the target's directory, not the link's
+	local buffer2 = buffer
+	local calls = {}
+	local handler = function(filename, filenames)
+		calls[#calls + 1] = filenames
+		return false -- halt propagation
+	end
+	events.connect(events.FILE_CHANGED, handler, 1)
+	if buffer1._watched and buffer2._watched then -- the platform can watch files
+		io.open(filename1, 'wb'):write('baz\n'):close()
+		io.open(filename2, 'wb'):write('quux\n'):close()
+		for _ = 1, 50 do
+			if #calls > 0 then break end
+			sleep(0.1)
+			ui.update()
+		end
+		sleep(1) -- past the next check for changes
+		ui.update()
+		assert_equal(#calls, 1)
+		local expected = {file(filename1), file(link)}
+		table.sort(calls[1])
+		table.sort(expected)
+		assert_equal(calls[1], expected)
+	end
+	events.disconnect(events.FILE_CHANGED, handler)
+	buffer1:close()
+	buffer2:close()
+	removedir(dir)
+end
+
+function test_file_io_reload_unmodified_files()
+	local filename1, filename2 = os.tmpname(), os.tmpname()
+	io.open(filename1, 'wb'):write('foo\n'):close()
+	io.open(filename2, 'wb'):write('foo\n'):close()
+	io.open_file(filename1)
+	local buffer1 = buffer
+	io.open_file(filename2)
+	buffer:append_text('baz\n') -- modified, so it would be prompted for
+	io.open(filename1, 'wb'):write('bar\n'):close()
+	local handler = function(filename, filenames)
+		assert_equal(filename, filename1)
+		assert_equal(filenames, {filename1})
+	end
+	events.connect(events.FILE_CHANGED, handler, 1)
+	io.reload_unmodified_files = true
+	events.emit(events.FILE_CHANGED, filename1, {filename1})
+	io.reload_unmodified_files = false
+	events.disconnect(events.FILE_CHANGED, handler)
+	assert_equal(buffer:get_text(), 'foo\nbaz\n')
+	assert_equal(buffer1:get_text(), 'bar\n')
+	assert(not buffer1.modify, 'buffer should not be modified')
+	buffer:close(true)
+	buffer1:close()
+	os.remove(filename1)
+	os.remove(filename2)
+end
+
+function test_file_io_read_stdin()
+	local read_stdin, append = io._read_stdin, nil
+	io._read_stdin = function(f)
+		append = f
+		return true -- watching stdin
+	end
+	buffer.new()
+	events.emit('command_line', {'-'})
+	io._read_stdin = read_stdin -- reset
+	assert(append, 'stdin should be watched')
+	local buffer = buffer
+	append('foo\n')
+	append('bar\n')
+	assert_equal(buffer:get_text(), 'foo\nbar\n')
+	assert(not buffer.modify, 'stdin input should not modify the buffer')
+	assert(not buffer:can_undo(), 'stdin input should not be undoable')
+	buffer:goto_pos(buffer.length + 1)
+	append('baz\n')
+	assert_equal(buffer.current_pos, buffer.length + 1) -- follows input
+	buffer:goto_pos(1)
+	append('quux\n')
+	assert_equal(buffer.current_pos, 1) -- does not follow input
+
+	io.stdin_max_lines = 10
+	local lines = {}
+	for i = 1, 20 do lines[i] = tostring(i) end
+	append(table.concat(lines, '\n') .. '\n') -- 25 lines total, including the last empty one
+	io.stdin_max_lines = 0 -- reset
+	assert_equal(buffer.line_count, 9) -- the oldest lines were removed, leaving 9/10 of the max
+	assert_equal(buffer:get_text(), table.concat(lines, '\n', 13) .. '\n')
+	assert(not buffer:can_undo(), 'removing lines should not be undoable')
+
+	append(nil) -- stdin closed
+	buffer:close()
+	append('foo\n') -- discarded
+end
+
 function test_file_io_recent_files()
 	io.recent_files = {} -- clear
 	local recent_files = {}
@@ -755,6 +1208,48 @@ function test_file_io_quick_open_interactive()
 	assert_raises(function() io.quick_open(_HOME, true) end, 'string/table/nil expected, got boolean')
 end
 
+function test_file_io_quick_open_cache()
+	local dir = os.tmpname()
+	os.remove(dir)
+	lfs.mkdir(dir)
+	lfs.mkdir(dir .. '/sub')
+	lfs.mkdir(dir .. '/excluded')
+	for _, name in ipairs{'foo.lua', 'bar.txt', 'sub/baz.lua', 'excluded/quux.lua'} do
+		io.open(dir .. '/' .. name, 'w'):close()
+	end
+	-- Directories modified within the last second are not cached, so backdate them.
+	local mtime = os.time() - 10
+	local function backdate()
+		for _, subdir in ipairs{'', '/sub', '/excluded'} do lfs.touch(dir .. subdir, mtime, mtime) end
+	end
+	backdate()
+	local list = ui.dialogs.list
+	local items
+	ui.dialogs.list = function(opts)
+		items = opts.items
+		table.sort(items)
+	end
+	local filter, sep = {'.lua', '!/excluded'}, not WIN32 and '/' or '\\'
+	io.quick_open(dir, filter)
+	assert_equal(items, {'foo.lua', 'sub' .. sep .. 'baz.lua'})
+	io.quick_open(dir, '!/sub') -- different filters have different lists
+	assert_equal(items, {'bar.txt', 'excluded' .. sep .. 'quux.lua', 'foo.lua'})
+
+	io.open(dir .. '/new.lua', 'w'):close()
+	backdate() -- hide the change from the cache
+	io.quick_open(dir, filter)
+	assert_equal(#items, 2) -- cached
+	io.open(dir .. '/sub/new.lua', 'w'):close()
+	io.quick_open(dir, filter)
+	assert_equal(#items, 3) -- only the changed directory was listed again
+	assert_equal(items[3], 'sub' .. sep .. 'new.lua')
+	lfs.touch(dir)
+	io.quick_open(dir, filter)
+	assert_equal(#items, 4)
+	ui.dialogs.list = list -- restore
+	removedir(dir)
+end
+
 function test_keys_keychain()
 	local ctrl_a = keys['ctrl+a']
 	local foo = false
@@ -1027,7 +1522,7 @@ function test_ui_print()
 	ui.goto_view(1) -- second view
 	assert_equal(buffer._type, _L['[Message Buffer]'])
 	assert(view.first_visible_line > 1, 'message view did not scroll')
-	buffer:undo() -- 100 \n
+	buffer:delete_range(buffer.length - 100, 101) -- 100 \n (print buffers have no undo history)
 	view:goto_buffer(-1)
 	assert(buffer._type ~= _L['[Message Buffer]'], 'message buffer still visible')
 	ui.print()
@@ -1039,6 +1534,25 @@ function test_ui_print()
 	ui.tabs = tabs
 end
 
+function test_ui_print_max_lines()
+	local max_lines = ui.print_max_lines
+	ui.print_max_lines = 100
+	for i = 1, 99 do ui.print_silent(i) end
+	local buffer = _BUFFERS[#_BUFFERS]
+	assert_equal(buffer._type, _L['[Message Buffer]'])
+	assert_equal(buffer.line_count, 100) -- includes trailing empty line
+	assert_equal(buffer:get_line(1), '1\n')
+	ui.print_silent(100)
+	assert_equal(buffer.line_count, 90)
+	assert_equal(buffer:get_line(1), '12\n')
+	assert_equal(buffer:get_line(89), '100\n')
+	assert(not buffer.modify, 'print buffer modified')
+	assert(not buffer:can_undo(), 'print buffer has undo history')
+	ui.print_max_lines = max_lines -- restore
+	view:goto_buffer(buffer)
+	buffer:close()
+end
+
 function test_ui_print_to_other_view()
 	view:split()
 	ui.goto_view(-1)
@@ -1155,11 +1669,45 @@ function test_ui_dialogs_list_interactive()
 	}
 	assert_equal(i, {2})
 	assert_equal(type(button), 'number')
+	local items = {1, 2, 3}
+	assert_equal(ui.dialogs.list{items = items, text = '3'}, 3)
+	assert_equal(math.type(items[1]), 'integer') -- the caller's items are not converted
 
 	assert_raises(function() ui.dialogs.list{} end, "non-empty 'items' table expected")
 	assert_raises(function() ui.dialogs.list{search_column = 2} end, "invalid 'search_column'")
 end
 
+function test_ui_dialogs_list_filter()
+	local items = {'foo', 'FooBar', 'bar', 'foo/bar/baz', 'Äpfel', ''}
+	local all, foo, foobar, foo_bar, bar_foo = ui.dialogs._filter(items, '', 'fo', 'foo', 'foo bar',
+		'bar foo')
+	assert_equal(all, {1, 2, 3, 4, 5, 6})
+	assert_equal(foo, {1, 2, 4})
+	assert_equal(foobar, {1, 2, 4})
+	assert_equal(foo_bar, {2, 4}) -- words match sequentially
+	assert_equal(bar_foo, {}) -- the key no longer extends the previous one
+	assert_equal({ui.dialogs._filter(items, 'bar', 'B')}, {{2, 3, 4}, {2, 3, 4}})
+	if os.setlocale(nil, 'ctype'):lower():find('utf%-?8') then
+		assert_equal(ui.dialogs._filter(items, 'äpf'), {5}) -- case folding is locale-dependent
+	end
+	assert_equal(ui.dialogs._filter(items, 'foo  '), {1, 2, 4}) -- extra spaces match anything
+	assert_equal(ui.dialogs._filter({}, 'foo'), {})
+
+	-- Large lists are filtered in parallel, keeping rows in order.
+	items = {}
+	for i = 1, 200000 do items[i] = string.format('%s%d', i % 3 == 0 and 'foo' or 'bar', i) end
+	local foo1, foo12 = ui.dialogs._filter(items, 'foo1', 'foo12')
+	local expected1, expected12 = {}, {}
+	for i = 1, #items do
+		if items[i]:find('^foo1') then expected1[#expected1 + 1] = i end
+		if items[i]:find('^foo12') then expected12[#expected12 + 1] = i end
+	end
+	assert_equal(foo1, expected1)
+	assert_equal(foo12, expected12)
+
+	assert_raises(function() ui.dialogs._filter({1}, '') end, 'strings expected')
+end
+
 function test_ui_switch_buffer_interactive()
 	local buffer_list_zorder = ui.buffer_list_zorder
 	ui.buffer_list_zorder = false
@@ -1258,6 +1806,21 @@ function test_ui_quit()
 	buffer:close(true)
 end
 
+function test_ui_memory_stats()
+	buffer.new()
+	buffer:append_text('foo\nbar')
+	local stats = ui.memory_stats()
+	assert(stats.lua.heap > 0, 'should report Lua heap')
+	assert(stats.lua.pool >= stats.lua.pool_free, 'should report pooled memory')
+	assert_equal(#stats.buffers, #_BUFFERS)
+	local buffer_stats = stats.buffers[_BUFFERS[buffer]]
+	assert_equal(buffer_stats.buffer, buffer)
+	assert_equal(buffer_stats.text, buffer.length)
+	assert_equal(buffer_stats.lines, 2)
+	assert_equal(type(stats.processes), 'table')
+	buffer:close(true)
+end
+
 function test_ui_quit_interactive()
 	buffer.new()
 	buffer:append_text('foo')
@@ -1329,6 +1892,25 @@ function test_spawn_callbacks()
 	assert_equal(#_BUFFERS, 1)
 end
 
+function test_spawn_callbacks_coalesce_output()
+	if WIN32 then return end -- TODO:
+	local chunks, exited = {}, false
+	os.spawn('lua -e "for i = 1, 100000 do print(i) end"',
+		function(output) chunks[#chunks + 1] = output end, nil, function() exited = true end)
+	for _ = 1, 100 do
+		if exited then break end
+		sleep(0.1)
+		ui.update()
+	end
+	assert(exited, 'process did not exit')
+	local output = table.concat(chunks)
+	assert_equal(select(2, output:gsub('\n', '')), 100000)
+	assert(#chunks < #output // 1024, 'output not coalesced')
+	for i = 1, #chunks - 1 do
+		if #chunks[i] == 64 * 1024 then assert(chunks[i]:find('\n$'), 'chunk split within a line') end
+	end
+end
+
 function test_spawn_wait()
 	local exit_status = -1
 	local p = os.spawn(not WIN32 and 'sleep 0.1' or 'ping 127.0.0.1 -n 2', nil, nil,
@@ -1341,6 +1923,49 @@ function test_spawn_wait()
 	assert_equal(p:wait(), exit_status)
 end
 
+function test_spawn_async()
+	local lines, status = {}, nil
+	coroutine.wrap(function()
+		local p = os.spawn_async(not WIN32 and 'printf "foo\nbar"' or 'echo foo')
+		local line = p:read()
+		while line do
+			lines[#lines + 1] = line
+			line = p:read()
+		end
+		status = p:wait()
+	end)()
+	if not (WIN32 and CURSES) then assert(not status, 'process blocked') end
+	for _ = 1, 10 do
+		if status then break end
+		sleep(0.1)
+		ui.update()
+	end
+	assert_equal(status, 0)
+	assert_equal(lines[1], not WIN32 and 'foo' or 'foo\r')
+	if not WIN32 then assert_equal(lines[2], 'bar') end
+
+	assert_raises(function() os.spawn_async('echo foo'):wait() end, 'must be called from a coroutine')
+end
+
+function test_spawn_async_multiple_waiters()
+	local p = os.spawn_async(not WIN32 and 'printf "foo\nbar\n"' or 'echo foo')
+	local lines, statuses = {}, {}
+	coroutine.wrap(function() lines[#lines + 1] = p:read() end)()
+	coroutine.wrap(function() statuses[#statuses + 1] = p:wait() end)()
+	coroutine.wrap(function() statuses[#statuses + 1] = p:wait() end)()
+	for _ = 1, 10 do
+		if #statuses == 2 then break end
+		sleep(0.1)
+		ui.update()
+	end
+	assert_equal(statuses, {0, 0})
+	assert_equal(lines, {not WIN32 and 'foo' or 'foo\r'})
+	if not WIN32 then
+		coroutine.wrap(function() lines[#lines + 1] = p:read('a') end)()
+		assert_equal(lines[2], 'bar\n')
+	end
+end
+
 function test_spawn_kill()
 	if WIN32 and CURSES then return end -- not supported
 	local p = os.spawn(not WIN32 and 'sleep 1' or 'ping 127.0.0.1 -n 2')
@@ -2370,6 +2995,44 @@ function test_editing_highlight_word()
 	textadept.editing.highlight_words = highlight -- reset
 end
 
+function test_editing_highlight_word_cached_matches()
+	local matches = require('textadept.matches')
+	buffer.new()
+	buffer:append_text(table.concat({'foo', 'bar foo', 'foo foo'}, newline()))
+	local flags = buffer.FIND_MATCHCASE
+	assert_equal(matches.count('foo', flags, 1), 4)
+	buffer:insert_text(1, 'foo' .. newline())
+	assert_equal(matches.count('foo', flags, 1), 5)
+	buffer:delete_range(buffer:position_from_line(3), buffer:line_length(3)) -- 'bar foo'
+	local count, current = matches.count('foo', flags, buffer:position_from_line(3) + 4)
+	assert_equal(count, 4)
+	assert_equal(current, 4)
+	buffer:close(true)
+end
+
+function test_editing_highlight_word_cached_matches_invalidation()
+	local matches = require('textadept.matches')
+	buffer.new()
+	buffer:set_text('foo bar')
+	local buffer1 = buffer
+	local flags = buffer.FIND_MATCHCASE
+	assert_equal(matches.count('foo', flags, 1), 1)
+	buffer.new()
+	local buffer2 = buffer
+	buffer1:set_target_range(1, buffer1.length + 1)
+	buffer1:replace_target('foo foo') -- same line count and length, in the background
+	view:goto_buffer(buffer1)
+	assert_equal(matches.count('foo', flags, 1), 2)
+	-- Regular expressions may match newlines without containing them.
+	buffer1:set_text('foo' .. newline() .. 'bar')
+	flags = buffer.FIND_REGEXP
+	assert_equal(matches.count('foo\\s+bar', flags, 1), 1)
+	buffer1:delete_range(buffer1:position_from_line(2), 3) -- line 1's match ends on line 2
+	assert_equal(matches.count('foo\\s+bar', flags, 1), 0)
+	buffer1:close(true)
+	buffer2:close(true)
+end
+
 function test_editing_filter_through()
 	buffer.new()
 	if not WIN32 then
@@ -2432,6 +3095,41 @@ function test_editing_filter_through()
 	assert_raises(function() textadept.editing.filter_through() end, 'string expected, got nil')
 end
 
+function test_editing_filter_through_large()
+	if WIN32 then return end -- uses Unix commands
+	buffer.new()
+	local lines = {}
+	for i = 1, 100000 do lines[i] = string.format('%06d', 100000 - i) end
+	buffer:set_text(table.concat(lines, '\n') .. '\n')
+	textadept.editing.filter_through('cat | sort | cat') -- more than a pipe can hold
+	assert_equal(buffer:get_line(1), '000000\n')
+	assert_equal(buffer:get_line(100000), '099999\n')
+	buffer:undo()
+	assert_equal(buffer:get_line(1), '099999\n') -- verify atomic undo
+	textadept.editing.filter_through('false')
+	assert_equal(buffer:get_line(1), '099999\n')
+	buffer:close(true)
+end
+
+function test_editing_filter_through_spawn_error_removes_temp_files()
+	if WIN32 and CURSES then return end -- not supported
+	local tmpname, spawn, filenames = os.tmpname, os.spawn, {}
+	os.tmpname = function()
+		filenames[#filenames + 1] = tmpname()
+		return filenames[#filenames]
+	end
+	os.spawn = function() error('spawn failed') end
+	buffer.new()
+	buffer:set_text('foo')
+	local ok, errmsg = pcall(textadept.editing.filter_through, 'cat')
+	os.tmpname, os.spawn = tmpname, spawn
+	assert_equal(buffer:get_text(), 'foo')
+	buffer:close(true)
+	assert(not ok and errmsg:find('spawn failed'), 'error not raised')
+	assert_equal(#filenames, 3)
+	for _, filename in ipairs(filenames) do assert(not lfs.attributes(filename), filename) end
+end
+
 function test_editing_autocomplete()
 	assert_raises(function() textadept.editing.autocomplete() end, 'string expected, got nil')
 end
@@ -2468,6 +3166,44 @@ function test_editing_autocomplete_word()
 	buffer:close(true)
 end
 
+function test_editing_autocomplete_word_index_updates()
+	buffer.new()
+	buffer:add_text('foobar baz f')
+	assert(textadept.editing.autocomplete('word'), 'did not autocomplete')
+	assert_equal(buffer:get_text(), 'foobar baz foobar')
+	buffer:set_sel(1, 4)
+	buffer:replace_sel('qux') -- quxbar baz foobar
+	buffer:set_sel(12, 18)
+	buffer:replace_sel('q') -- quxbar baz q
+	buffer:goto_pos(buffer.length + 1)
+	assert(textadept.editing.autocomplete('word'), 'did not autocomplete')
+	assert_equal(buffer:get_text(), 'quxbar baz quxbar')
+	buffer:add_text(' f')
+	assert(not textadept.editing.autocomplete('word'), 'completed a word that no longer exists')
+	buffer:close(true)
+end
+
+function test_editing_autocomplete_word_index_background_changes()
+	local all_words = textadept.editing.autocomplete_all_words
+	textadept.editing.autocomplete_all_words = true
+	buffer.new()
+	buffer:set_text('foobar')
+	local buffer1 = buffer
+	buffer.new()
+	buffer:add_text('f')
+	assert(textadept.editing.autocomplete('word'), 'did not autocomplete')
+	assert_equal(buffer:get_text(), 'foobar')
+	buffer1:set_target_range(1, buffer1.length + 1)
+	buffer1:replace_target('fizbuz') -- same length, in the background
+	buffer:set_text('f')
+	buffer:goto_pos(2)
+	assert(textadept.editing.autocomplete('word'), 'did not autocomplete')
+	assert_equal(buffer:get_text(), 'fizbuz')
+	buffer:close(true)
+	buffer1:close(true)
+	textadept.editing.autocomplete_all_words = all_words
+end
+
 function test_ui_find_find_text()
 	local wrapped = false
 	local handler = function() wrapped = true end
@@ -2820,6 +3556,48 @@ function test_ui_find_in_files_single_char()
 	buffer:close()
 end
 
+function test_ui_find_in_files_skip_non_matching()
+	local dir = os.tmpname()
+	os.remove(dir)
+	lfs.mkdir(dir)
+	for i = 1, 150 do io.open(string.format('%s/%03d.txt', dir, i), 'wb'):write('bar\n'):close() end
+	io.open(dir .. '/001.txt', 'wb'):write('FOO\n'):close()
+	io.open(dir .. '/150.txt', 'wb'):write('b\195\164r\nfOo\n'):close()
+	ui.find.find_entry_text, ui.find.match_case = 'foo', false
+	ui.find.find_in_files(dir)
+	local results = buffer:get_text()
+	assert(results:find('001.txt:1:FOO'), 'case-insensitive ASCII match not found')
+	assert(results:find('150.txt:2:fOo'), 'case-insensitive non-ASCII file match not found')
+	assert(not results:find('002.txt'), 'non-matching file found')
+	buffer:clear_all()
+	ui.find.match_case = true
+	ui.find.find_in_files(dir)
+	assert(buffer:get_text():find(_L['No results found']), 'case-sensitive match found')
+	ui.find.find_entry_text, ui.find.match_case = '', false
+	buffer:close()
+	ui.goto_view(1)
+	view:unsplit()
+	removedir(dir)
+end
+
+function test_ui_find_in_files_may_contain()
+	local dir = os.tmpname()
+	os.remove(dir)
+	lfs.mkdir(dir)
+	local contents = {'foo bar', 'FOO', 'f\195\182o', '', 'xfoxfoo'}
+	local filenames = {}
+	for i, text in ipairs(contents) do
+		filenames[i] = string.format('%s/%d.txt', dir, i)
+		io.open(filenames[i], 'wb'):write(text):close()
+	end
+	filenames[#filenames + 1] = dir .. '/nonexistent.txt' -- might, so searching it reports errors
+	assert_equal(io._may_contain(filenames, 'foo', true), {true, false, false, false, true, true})
+	assert_equal(io._may_contain(filenames, 'foo', false), {true, true, true, false, true, true})
+	assert_equal(io._may_contain(filenames, 'baz', false), {false, false, true, false, false, true})
+	assert_equal(io._may_contain({}, 'foo'), {})
+	removedir(dir)
+end
+
 function test_ui_find_replace()
 	buffer.new()
 	buffer:set_text('foofoo')
@@ -2910,6 +3688,53 @@ function test_ui_find_replace_all()
 	buffer:close(true)
 end
 
+function test_ui_find_replace_all_one_undo_action()
+	buffer.new()
+	local lines = {}
+	for i = 1, 1000 do lines[i] = string.format('foo%d = bar%d', i, i) end
+	local text = table.concat(lines, '\n')
+	buffer:set_text(text)
+	ui.find.find_entry_text, ui.find.replace_entry_text = 'foo(\\d+) = bar\\1', 'bar\\1 = foo'
+	ui.find.regex = true
+	local replaced = 0
+	local function count_replaced() replaced = replaced + 1 end
+	events.connect(events.BUFFER_AFTER_REPLACE_TEXT, count_replaced)
+	ui.find.replace_all()
+	events.disconnect(events.BUFFER_AFTER_REPLACE_TEXT, count_replaced)
+	assert_equal(replaced, 0) -- only emitted when replacing all buffer text
+	assert_equal(buffer:get_line(1), 'bar1 = foo\n')
+	assert_equal(buffer:get_line(1000), 'bar1000 = foo')
+	buffer:undo()
+	assert_equal(buffer:get_text(), text) -- verify one undo action
+	ui.find.regex = false
+	buffer:set_sel(buffer:position_from_line(2), buffer.line_end_position[3])
+	ui.find.find_entry_text, ui.find.replace_entry_text = 'bar', 'quux'
+	ui.find.replace_all() -- replace in selection
+	assert_equal(buffer:get_line(1), 'foo1 = bar1\n')
+	assert_equal(buffer:get_line(3), 'foo3 = quux3\n')
+	assert_equal(buffer:get_line(4), 'foo4 = bar4\n')
+	assert_equal(buffer.selection_end, buffer.line_end_position[3])
+	ui.find.find_entry_text, ui.find.replace_entry_text = '', ''
+	buffer:close(true)
+end
+
+function test_ui_find_replace_all_keeps_markers()
+	buffer.new()
+	buffer:set_text('foo\nbar\nfoo\nbar\nbaz')
+	local BOOKMARK_BIT = 1 << textadept.bookmarks.MARK_BOOKMARK - 1
+	buffer:marker_add(2, textadept.bookmarks.MARK_BOOKMARK) -- between matches
+	buffer:marker_add(5, textadept.bookmarks.MARK_BOOKMARK) -- after matches
+	ui.find.find_entry_text, ui.find.replace_entry_text = 'foo', 'quux'
+	ui.find.replace_all()
+	assert_equal(buffer:get_text(), 'quux\nbar\nquux\nbar\nbaz')
+	assert_equal(buffer:marker_next(1, BOOKMARK_BIT), 2)
+	assert_equal(buffer:marker_next(3, BOOKMARK_BIT), 5)
+	buffer:marker_delete(5, textadept.bookmarks.MARK_BOOKMARK)
+	assert_equal(buffer:marker_next(3, BOOKMARK_BIT), -1) -- not duplicated
+	ui.find.find_entry_text, ui.find.replace_entry_text = '', ''
+	buffer:close(true)
+end
+
 function test_ui_find_replace_all_empty_matches()
 	buffer.new()
 	buffer:set_text('1\n2\n3\n4')
@@ -3212,6 +4037,36 @@ function test_history_undo_full_buffer_change()
 	buffer:close(true)
 end
 
+function test_history_records_shift_with_edits()
+	buffer.new()
+	buffer:add_text(string.rep(newline(), 30))
+	textadept.history.clear()
+	buffer:goto_line(20)
+	buffer:add_text('foo')
+	buffer:goto_line(1)
+	buffer:add_text(string.rep(newline(), 5)) -- shift the record on line 20 down
+	textadept.history.back()
+	assert_equal(buffer:line_from_position(buffer.current_pos), 25)
+	assert_equal(buffer.current_pos, buffer.line_end_position[25])
+	buffer:close(true)
+end
+
+function test_history_replace_all_single_record()
+	buffer.new()
+	buffer:add_text(string.rep('foo' .. newline(), 50))
+	textadept.history.clear()
+	buffer:goto_line(1)
+	ui.find.find_entry_text, ui.find.replace_entry_text = 'foo', 'bar'
+	ui.find.replace_all()
+	ui.find.find_entry_text, ui.find.replace_entry_text = '', ''
+	buffer:goto_line(30)
+	textadept.history.back() -- should jump to the last replacement, not one of many records
+	local line = buffer:line_from_position(buffer.current_pos)
+	textadept.history.back() -- should not do anything
+	assert_equal(buffer:line_from_position(buffer.current_pos), line)
+	buffer:close(true)
+end
+
 function test_history_multiple_selection_edit()
 	for i = 1, 5 do ui.print(i) end
 	for i = 5, 1, -1 do ui.print(i) end
@@ -3309,6 +4164,32 @@ function test_macro_registers()
 	buffer:close(true)
 end
 
+function test_macro_play_multiple_times()
+	buffer.new()
+	buffer.eol_mode = buffer.EOL_LF
+	buffer:append_text('1\n2\n3\n4\n')
+	textadept.macros.record()
+	for _, char in ipairs{'f', 'o', 'o'} do
+		events.emit(events.KEYPRESS, char)
+		buffer:add_text(char) -- typing would do this
+		events.emit(events.CHAR_ADDED, string.byte(char))
+	end
+	events.emit(events.KEYPRESS, 'down')
+	events.emit(events.KEYPRESS, 'home')
+	textadept.macros.record() -- stop
+	textadept.macros.play(nil, 2)
+	assert_equal(buffer:get_text(), 'foo1\nfoo2\nfoo3\n4\n')
+	assert_equal(buffer:line_from_position(buffer.current_pos), 4)
+	buffer:undo()
+	assert_equal(buffer:get_text(), 'foo1\n2\n3\n4\n') -- verify one undo action
+	buffer:redo()
+	buffer:goto_line(4)
+	textadept.macros.play(nil, 0) -- until the end of the buffer
+	assert_equal(buffer:get_text(), 'foo1\nfoo2\nfoo3\nfoo4\n')
+	assert_raises(function() textadept.macros.play(nil, '1') end, 'number/nil expected, got string')
+	buffer:close(true)
+end
+
 function test_macro_record_play_with_keys_only()
 	buffer.new()
 	buffer.eol_mode = buffer.EOL_LF
@@ -3848,6 +4729,116 @@ function test_session_save()
 	events.disconnect(events.SESSION_SAVE, handler)
 end
 
+function test_session_load_deferred()
+	local test_output_text = buffer:get_text()
+	local foo, bar = os.tmpname(), os.tmpname()
+	io.open(foo, 'wb'):write('foo\nfoo\nfoo\n'):close()
+	io.open(bar, 'wb'):write('bar\n'):close()
+	io.open_file(foo)
+	buffer:goto_line(2)
+	textadept.bookmarks.toggle()
+	io.open_file(bar)
+	local session_file = os.tmpname()
+	textadept.session.save(session_file)
+	textadept.session.load(session_file)
+	local foo_buffer = _BUFFERS[#_BUFFERS - 1]
+	assert_equal(foo_buffer.filename, foo)
+	assert(foo_buffer._deferred, 'file loaded before being shown')
+	assert_equal(foo_buffer.length, 0)
+	assert_equal(buffer.filename, bar)
+	assert_equal(buffer:get_text(), 'bar\n')
+	textadept.session.save(session_file) -- should retain unloaded buffer state
+	textadept.session.load(session_file)
+	view:goto_buffer(_BUFFERS[#_BUFFERS - 1])
+	assert_equal(buffer.filename, foo)
+	assert_equal(buffer:get_text(), 'foo\nfoo\nfoo\n')
+	assert(not buffer.modify, 'loaded buffer modified')
+	assert_equal(buffer:line_from_position(buffer.current_pos), 2)
+	assert(buffer:marker_get(2) & 1 << textadept.bookmarks.MARK_BOOKMARK - 1 > 0, 'no bookmark')
+	buffer:close()
+	buffer:close()
+	os.remove(foo)
+	os.remove(bar)
+	os.remove(session_file)
+	buffer:add_text(test_output_text)
+end
+
+function test_session_save_as_and_reload_deferred()
+	local test_output_text = buffer:get_text()
+	local foo, bar, baz = os.tmpname(), os.tmpname(), os.tmpname()
+	io.open(foo, 'wb'):write('foo\n'):close()
+	io.open(bar, 'wb'):write('bar\n'):close()
+	io.open_file(foo)
+	io.open_file(bar)
+	local session_file = os.tmpname()
+	textadept.session.save(session_file)
+	textadept.session.load(session_file)
+	local foo_buffer = _BUFFERS[#_BUFFERS - 1]
+	assert(foo_buffer._deferred, 'file loaded before being shown')
+	foo_buffer:save_as(baz)
+	assert(not foo_buffer._deferred, 'file not loaded before being saved')
+	assert_equal(foo_buffer.filename, baz)
+	local f = io.open(baz, 'rb')
+	assert_equal(f:read('a'), 'foo\n')
+	f:close()
+	buffer:close()
+	buffer:close()
+	textadept.session.load(session_file)
+	foo_buffer = _BUFFERS[#_BUFFERS - 1]
+	assert(foo_buffer._deferred, 'file loaded before being shown')
+	foo_buffer:reload()
+	assert(not foo_buffer._deferred, 'file not loaded when reloaded')
+	assert_equal(foo_buffer:get_text(), 'foo\n')
+	assert(not foo_buffer.modify, 'reloaded buffer modified')
+	buffer:close()
+	buffer:close()
+	os.remove(foo)
+	os.remove(bar)
+	os.remove(baz)
+	os.remove(session_file)
+	buffer:add_text(test_output_text)
+end
+
+function test_session_load_deferred_missing_or_unreadable()
+	local test_output_text = buffer:get_text()
+	local foo, bar = os.tmpname(), os.tmpname()
+	io.open(foo, 'wb'):write('foo\n'):close()
+	io.open(bar, 'wb'):write('bar\n'):close()
+	io.open_file(foo)
+	io.open_file(bar)
+	local session_file = os.tmpname()
+	textadept.session.save(session_file)
+	textadept.session.load(session_file)
+	os.remove(foo)
+	view:goto_buffer(_BUFFERS[#_BUFFERS - 1])
+	assert_equal(buffer.filename, foo) -- opened as a new file
+	assert_equal(buffer.length, 0)
+	buffer:close()
+	buffer:close()
+
+	io.open(foo, 'wb'):write('foo\n'):close()
+	textadept.session.load(session_file)
+	os.remove(foo)
+	lfs.mkdir(foo) -- exists, but cannot be read
+	local errmsg
+	local function handler(message)
+		errmsg = message
+		return false -- halt propagation
+	end
+	events.connect(events.ERROR, handler, 1)
+	view:goto_buffer(_BUFFERS[#_BUFFERS - 1])
+	events.disconnect(events.ERROR, handler)
+	assert(errmsg and errmsg:find('cannot open'), 'error not reported')
+	assert(not buffer._deferred, 'still deferred')
+	assert(not buffer.filename, 'could be saved over unloaded file')
+	buffer:close(true)
+	buffer:close()
+	lfs.rmdir(foo)
+	os.remove(bar)
+	os.remove(session_file)
+	buffer:add_text(test_output_text)
+end
+
 function test_session_save_before_load()
 	local test_output_text = buffer:get_text()
 	local foo = os.tmpname()
@@ -4235,6 +5226,17 @@ function test_ui_maximized()
 end
 if LINUX and GTK then expected_failure(test_ui_maximized) end
 
+function test_scintilla_functions_cached()
+	assert_equal(buffer.get_text, buffer.get_text)
+	assert_equal(buffer.get_text, view.get_text)
+	local buf = buffer.new()
+	buf:set_text('foo')
+	view:goto_buffer(-1)
+	assert_equal(buf.get_text(buf), 'foo') -- cached function still operates on the given buffer
+	assert_equal(buf:get_text(), 'foo')
+	buf:close(true)
+end
+
 function test_move_buffer()
 	local buffer1 = buffer.new()
 	buffer1:set_text('1')
@@ -4285,7 +5287,7 @@ function test_reset()
 end
 
 function test_timeout()
-	if CURSES then
+	if WIN32 and CURSES then
 		assert_raises(function() timeout(1, function() end) end, 'could not add timeout')
 		return
 	end
@@ -4674,7 +5676,7 @@ end
 -- TODO: debug status buffers
 
 function test_export_interactive()
-	if CURSES then return end -- cannot add timeout
+	if WIN32 and CURSES then return end -- cannot add timeout
 	local export = require('export')
 	buffer.new()
 	buffer:add_text("_G.foo=table.concat{1,'bar',true,print}\nbar=[[<>& ]]")